@@ -0,0 +1,254 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <err.h>
+#include <sys/stat.h>
+
+#include "autotune.h"
+#include "metrics.h"
+
+using namespace cv;
+
+#define TUNE_WARMUP 2
+#define TUNE_MIN_NS 50000000ULL   // time each candidate for at least 50ms
+#define TUNE_MIN_RUNS 3
+
+static const int band_candidates[] = {0, 16, 32, 64, 160};
+
+// Cache file for this host; the directory is created if needed
+static void cachePath(char *path, size_t len, bool create)
+{
+  char host[64];
+  if (gethostname(host, sizeof(host)) < 0) {
+    strcpy(host, "localhost");
+  }
+  host[sizeof(host) - 1] = '\0';
+
+  const char *xdg = getenv("XDG_CACHE_HOME");
+  const char *home = getenv("HOME");
+  if (xdg && xdg[0]) {
+    snprintf(path, len, "%s", xdg);
+  } else {
+    snprintf(path, len, "%s/.cache", home ? home : "/tmp");
+  }
+  if (create) {
+    mkdir(path, 0755);
+  }
+  size_t n = strlen(path);
+  snprintf(path + n, len - n, "/sobel-autotune");
+  if (create && mkdir(path, 0755) < 0 && errno != EEXIST) {
+    warn("cannot create %s", path);
+  }
+  n = strlen(path);
+  snprintf(path + n, len - n, "/%s", host);
+}
+
+// The part of a cache line identifying the work being tuned for. The batch
+// size is part of it since it sets how often the workers are dispatched.
+static void cacheKey(const struct sobel_config *config, int type, int batch, char *key, size_t len)
+{
+  snprintf(key, len, "%dx%dx%d levels=%d wide=%d stats=%d batch=%d", config->width, config->height,
+           CV_MAT_CN(type), config->pyr_levels, config->wide_output ? 1 : 0,
+           config->edge_stats ? 1 : 0, batch);
+}
+
+/*******************************************
+ * Model: autotune_run
+ * Input: Configuration to tune (size, type and outputs are kept), frame
+ *  type, frames per batch
+ * Output: None directly. Fills res with the fastest scheduling
+ * Desc: Times every combination of threads (1 up to the online CPUs),
+ *  band height, fused and kernels on random frames. Band heights that the
+ *  context rounds to one already tried are skipped. Each candidate gets a
+ *  warm-up, then runs for at least TUNE_MIN_NS.
+ ********************************************/
+void autotune_run(const struct sobel_config *config, int type, int batch,
+                  struct autotune_result *res)
+{
+  int max_threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+  if (max_threads < 1) {
+    max_threads = 1;
+  }
+
+  // Synthetic input; noise keeps the edge statistics busy in every tile
+  struct sobel_arena arena;
+  if (sobelArenaInit(&arena, batch * sobelFrameBytes(config->height, config->width, type),
+                     config->pages) < 0) {
+    err(1, "autotune: cannot map frame buffers");
+  }
+  Mat *frames = new Mat[batch];
+  srand(1);
+  for (int k = 0; k < batch; k++) {
+    frames[k] = sobelArenaMat(&arena, config->height, config->width, type);
+    for (int i = 0; i < config->height; i++) {
+      unsigned char *row = frames[k].data + frames[k].step * i;
+      for (size_t j = 0; j < frames[k].cols * frames[k].elemSize(); j++) {
+        row[j] = rand();
+      }
+    }
+  }
+
+  // threads x bands x fused x kernels
+  int nbands = sizeof(band_candidates) / sizeof(band_candidates[0]);
+  struct autotune_result *tried = new struct autotune_result[max_threads * nbands * 4];
+  int ntried = 0;
+  res->ns_per_frame = 0;
+
+  for (int threads = 1; threads <= max_threads; threads++) {
+    for (int b = 0; b < nbands; b++) {
+      for (int fused = 0; fused < 2; fused++) {
+        for (int kernels = SOBEL_KERNELS_SPECIALIZED; kernels <= SOBEL_KERNELS_GENERIC; kernels++) {
+          struct sobel_config c = *config;
+          c.threads = threads;
+          c.band_rows = band_candidates[b];
+          c.fused = fused;
+          c.kernels = kernels;
+          SobelContext ctx(c);
+          if (ctx.error()) {
+            warnx("autotune: skipping %d threads: %s", threads, ctx.error());
+            continue;
+          }
+
+          struct autotune_result cand;
+          cand.threads = threads;
+          cand.band_rows = ctx.config().band_rows;
+          cand.fused = fused;
+          cand.kernels = kernels;
+          bool seen = false;
+          for (int t = 0; t < ntried && !seen; t++) {
+            seen = tried[t].threads == cand.threads && tried[t].band_rows == cand.band_rows &&
+                   tried[t].fused == cand.fused && tried[t].kernels == cand.kernels;
+          }
+          if (seen) {
+            continue;
+          }
+
+          bool ok = true;
+          for (int w = 0; w < TUNE_WARMUP && ok; w++) {
+            ok = ctx.process_batch(frames, batch) != NULL;
+          }
+          uint64_t start = metrics_now(), elapsed;
+          int runs = 0;
+          do {
+            ok = ok && ctx.process_batch(frames, batch) != NULL;
+            runs++;
+            elapsed = metrics_now() - start;
+          } while (ok && (runs < TUNE_MIN_RUNS || elapsed < TUNE_MIN_NS));
+          if (!ok) {
+            warnx("autotune: skipping %d threads: %s", threads, ctx.error());
+            continue;
+          }
+
+          cand.ns_per_frame = (double)elapsed / ((double)runs * batch);
+          tried[ntried++] = cand;
+          if (res->ns_per_frame == 0 || cand.ns_per_frame < res->ns_per_frame) {
+            *res = cand;
+          }
+        }
+      }
+    }
+  }
+
+  delete[] tried;
+  delete[] frames;
+  sobelArenaFree(&arena);
+  if (res->ns_per_frame == 0) {
+    errx(1, "autotune: no schedule could be run");
+  }
+}
+
+/*******************************************
+ * Model: autotune_load
+ * Input: Configuration, frame type and frames per batch about to be run
+ * Output: true and res filled in if this host has a cached result for them
+ * Desc: Cache lines are "<key> threads=T band_rows=B fused=F kernels=K
+ *  ns=N", see cacheKey
+ ********************************************/
+bool autotune_load(const struct sobel_config *config, int type, int batch,
+                   struct autotune_result *res)
+{
+  char path[512], key[128], line[256];
+  cachePath(path, sizeof(path), false);
+  cacheKey(config, type, batch, key, sizeof(key));
+  size_t keylen = strlen(key);
+
+  FILE *f = fopen(path, "r");
+  if (f == NULL) {
+    return false;
+  }
+
+  bool found = false;
+  while (!found && fgets(line, sizeof(line), f)) {
+    if (strncmp(line, key, keylen) != 0 || line[keylen] != ' ') {
+      continue;
+    }
+    found = sscanf(line + keylen, " threads=%d band_rows=%d fused=%d kernels=%d ns=%lf",
+                   &res->threads, &res->band_rows, &res->fused, &res->kernels,
+                   &res->ns_per_frame) == 5;
+    if (found && (res->threads < 1 || res->band_rows < 0 ||
+                  res->kernels < SOBEL_KERNELS_SPECIALIZED || res->kernels > SOBEL_KERNELS_GENERIC)) {
+      warnx("ignoring bad autotune entry in %s", path);
+      found = false;
+    }
+  }
+  fclose(f);
+  return found;
+}
+
+// Replaces the line for this key, keeping the others, via a rename so a
+// concurrent reader never sees a partial file
+void autotune_save(const struct sobel_config *config, int type, int batch,
+                   const struct autotune_result *res)
+{
+  char path[512], tmp[520], key[128], line[256];
+  cachePath(path, sizeof(path), true);
+  cacheKey(config, type, batch, key, sizeof(key));
+  size_t keylen = strlen(key);
+  snprintf(tmp, sizeof(tmp), "%s.%d", path, (int)getpid());
+
+  FILE *out = fopen(tmp, "w");
+  if (out == NULL) {
+    warn("cannot write autotune cache %s", tmp);
+    return;
+  }
+  FILE *in = fopen(path, "r");
+  if (in) {
+    while (fgets(line, sizeof(line), in)) {
+      if (strncmp(line, key, keylen) != 0 || line[keylen] != ' ') {
+        fputs(line, out);
+      }
+    }
+    fclose(in);
+  }
+  fprintf(out, "%s threads=%d band_rows=%d fused=%d kernels=%d ns=%.0f\n", key,
+          res->threads, res->band_rows, res->fused, res->kernels, res->ns_per_frame);
+
+  if (fclose(out) != 0 || rename(tmp, path) < 0) {
+    warn("cannot write autotune cache %s", path);
+    unlink(tmp);
+  }
+}
+
+void autotune_apply(const struct autotune_result *res, struct sobel_config *config)
+{
+  config->threads = res->threads;
+  config->band_rows = res->band_rows;
+  config->fused = res->fused;
+  config->kernels = res->kernels;
+}
+
+// One line summary of the scheduling of config, for reports
+void autotune_describe(const struct sobel_config *config, char *buf, size_t len)
+{
+  char bands[32];
+  if (config->band_rows) {
+    snprintf(bands, sizeof(bands), "bands of %d rows", config->band_rows);
+  } else {
+    snprintf(bands, sizeof(bands), "one band per thread");
+  }
+  snprintf(buf, len, "%d threads, %s, %s, %s kernels", config->threads, bands,
+           config->fused ? "fused" : "separate passes",
+           config->kernels == SOBEL_KERNELS_GENERIC ? "generic" : "specialized");
+}
@@ -0,0 +1,31 @@
+#ifndef AUTOTUNE_H
+#define AUTOTUNE_H
+
+#include <stddef.h>
+#include "sobel.h"
+
+// Per-host choice of the SobelContext scheduling knobs. autotune_run times
+// every combination of worker count, band height, fused or separate Sobel
+// pass and specialized or generic kernels on synthetic frames, and keeps
+// the fastest. Results are cached in $XDG_CACHE_HOME/sobel-autotune/<host>
+// (~/.cache if unset), one line per frame size, type, set of outputs and
+// batch size, so later runs on the same host can load them at startup.
+
+struct autotune_result {
+  int threads;
+  int band_rows;
+  int fused;
+  int kernels;
+  double ns_per_frame;
+};
+
+void autotune_run(const struct sobel_config *config, int type, int batch,
+                  struct autotune_result *res);
+bool autotune_load(const struct sobel_config *config, int type, int batch,
+                   struct autotune_result *res);
+void autotune_save(const struct sobel_config *config, int type, int batch,
+                   const struct autotune_result *res);
+void autotune_apply(const struct autotune_result *res, struct sobel_config *config);
+void autotune_describe(const struct sobel_config *config, char *buf, size_t len);
+
+#endif
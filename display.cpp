@@ -0,0 +1,120 @@
+#include <stdio.h>
+#include <err.h>
+#include <pthread.h>
+
+#include "display.h"
+#include "metrics.h"
+
+using namespace cv;
+
+static const char *window_names[PYR_MAX_LEVELS] = {"Sobel Top", "Sobel Top 1/2", "Sobel Top 1/4"};
+
+/*******************************************
+ * Model: displayMain
+ * Input: None
+ * Output: None
+ * Desc: Sink thread. Waits for a fresh frame, takes it as the front
+ *  buffer and shows it. HighGUI windows are only touched from here.
+ ********************************************/
+static void *displayMain(void *ptr)
+{
+  struct display_sink *ds = (struct display_sink *)ptr;
+
+  for (int l = 0; l < ds->nlevels; l++) {
+    namedWindow(window_names[l], CV_WINDOW_AUTOSIZE);
+  }
+
+  while (1) {
+    pthread_mutex_lock(&ds->lock);
+    while (!ds->fresh && !ds->stop) {
+      pthread_cond_wait(&ds->cond, &ds->lock);
+    }
+    if (!ds->fresh) {
+      pthread_mutex_unlock(&ds->lock);
+      break;
+    }
+    int shown = ds->ready;
+    ds->ready = ds->front;
+    ds->front = shown;
+    ds->fresh = false;
+    metrics_queue_depth(QUEUE_DISPLAY, 0);
+    pthread_mutex_unlock(&ds->lock);
+
+    for (int l = 0; l < ds->nlevels; l++) {
+      imshow(window_names[l], ds->slots[shown][l]);
+    }
+    ds->shown++;
+
+    char c = cvWaitKey(10);
+    if (c == 'q') {
+      ds->quit = true;
+    }
+  }
+  return NULL;
+}
+
+void display_start(struct display_sink *ds, int nlevels)
+{
+  ds->nlevels = nlevels;
+  ds->front = 0;
+  ds->ready = 1;
+  ds->back = 2;
+  ds->fresh = false;
+  ds->stop = false;
+  ds->quit = false;
+  ds->shown = 0;
+  ds->skipped = 0;
+
+  pthread_mutex_init(&ds->lock, NULL);
+  pthread_cond_init(&ds->cond, NULL);
+
+  int ret;
+  if ((ret = pthread_create(&ds->thread, NULL, displayMain, ds))) {
+    errx(1, "Display thread creation failed: %d", ret);
+  }
+}
+
+/*******************************************
+ * Model: display_submit
+ * Input: Sobel output levels of one frame
+ * Output: None
+ * Desc: Copies the frame into the back buffer and publishes it as the
+ *  latest frame. Never waits for the sink; if the previous frame was not
+ *  picked up yet it is dropped.
+ ********************************************/
+void display_submit(struct display_sink *ds, Mat levels[])
+{
+  for (int l = 0; l < ds->nlevels; l++) {
+    levels[l].copyTo(ds->slots[ds->back][l]);
+  }
+
+  pthread_mutex_lock(&ds->lock);
+  int filled = ds->back;
+  ds->back = ds->ready;
+  ds->ready = filled;
+  if (ds->fresh) {
+    ds->skipped++;
+  }
+  ds->fresh = true;
+  metrics_queue_depth(QUEUE_DISPLAY, 1);
+  pthread_cond_signal(&ds->cond);
+  pthread_mutex_unlock(&ds->lock);
+}
+
+bool display_quit(struct display_sink *ds)
+{
+  return ds->quit;
+}
+
+// Shows the last submitted frame, if any, then joins the sink
+void display_stop(struct display_sink *ds)
+{
+  pthread_mutex_lock(&ds->lock);
+  ds->stop = true;
+  pthread_cond_signal(&ds->cond);
+  pthread_mutex_unlock(&ds->lock);
+
+  pthread_join(ds->thread, NULL);
+  pthread_cond_destroy(&ds->cond);
+  pthread_mutex_destroy(&ds->lock);
+}
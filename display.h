@@ -0,0 +1,37 @@
+#ifndef DISPLAY_H
+#define DISPLAY_H
+
+#include <pthread.h>
+#include "opencv2/highgui/highgui.hpp"
+#include "sobel.h"
+
+// Shows Sobel output on its own thread so the frame loop never waits on
+// imshow/cvWaitKey. Frames go through a triple buffer: the frame loop
+// fills the back buffer and swaps it with the ready one, the sink swaps
+// the ready buffer with the one it shows. A frame that is still ready when
+// the next one comes in is overwritten, so the sink always shows the
+// latest frame and stale ones are skipped instead of queued.
+
+#define DISPLAY_SLOTS 3
+
+struct display_sink {
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  int nlevels;
+
+  cv::Mat slots[DISPLAY_SLOTS][PYR_MAX_LEVELS];
+  int front, ready, back;   // slot being shown, latest complete, being filled
+  bool fresh;               // ready holds a frame the sink has not shown
+  bool stop;
+  volatile bool quit;       // 'q' was pressed in a window
+
+  long shown, skipped;
+};
+
+void display_start(struct display_sink *ds, int nlevels);
+void display_submit(struct display_sink *ds, cv::Mat levels[]);
+bool display_quit(struct display_sink *ds);
+void display_stop(struct display_sink *ds);
+
+#endif
@@ -0,0 +1,300 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <glob.h>
+#include <strings.h>
+#include <time.h>
+
+#include "energy.h"
+
+static uint64_t now_ns()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Read a decimal sysfs value from an already open file; 0 on error
+static uint64_t readValue(int fd)
+{
+  char buf[32];
+  ssize_t n = pread(fd, buf, sizeof(buf) - 1, 0);
+  if (n <= 0) {
+    return 0;
+  }
+  buf[n] = '\0';
+  return strtoull(buf, NULL, 10);
+}
+
+static uint64_t readFileValue(const char *path)
+{
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    return 0;
+  }
+  uint64_t value = readValue(fd);
+  close(fd);
+  return value;
+}
+
+// Read a one-line sysfs string into buf, without the newline; false if
+// the file is missing or empty
+static bool readFileString(const char *path, char *buf, size_t len)
+{
+  FILE *f = fopen(path, "r");
+  if (f == NULL) {
+    return false;
+  }
+  bool ok = fgets(buf, len, f) != NULL;
+  fclose(f);
+  if (ok) {
+    buf[strcspn(buf, "\n")] = '\0';
+  }
+  return ok && buf[0] != '\0';
+}
+
+// Replace the last path component of path (after its last '/') with file
+static void siblingPath(char *out, size_t len, const char *path, const char *file)
+{
+  snprintf(out, len, "%s", path);
+  char *slash = strrchr(out, '/');
+  if (slash != NULL) {
+    snprintf(slash + 1, len - (slash + 1 - out), "%s", file);
+  }
+}
+
+/*******************************************
+ * Model: openDomain
+ * Input: Counter path and the name to report it under
+ * Output: true if the counter could be read and was added to em
+ * Desc: Only keeps counters that can actually be read (RAPL is root-only
+ *  on recent kernels)
+ ********************************************/
+static bool openDomain(struct energy_meter *em, const char *path, const char *name)
+{
+  if (em->ndomains == ENERGY_MAX_DOMAINS) {
+    return false;
+  }
+  int fd = open(path, O_RDONLY);
+  char probe[32];
+  if (fd < 0) {
+    return false;
+  }
+  if (pread(fd, probe, sizeof(probe), 0) <= 0) {
+    close(fd);
+    return false;
+  }
+
+  int d = em->ndomains++;
+  em->fd[d] = fd;
+  em->range[d] = 0;
+  em->last[d] = readValue(fd);
+  snprintf(em->name[d], sizeof(em->name[d]), "%s", name);
+
+  // RAPL counters wrap at max_energy_range_uj, next to energy_uj
+  if (em->source == ENERGY_RAPL) {
+    char range_path[256];
+    siblingPath(range_path, sizeof(range_path), path, "max_energy_range_uj");
+    em->range[d] = readFileValue(range_path);
+  }
+  return true;
+}
+
+/*******************************************
+ * Model: openRapl
+ * Input: None
+ * Output: Number of RAPL domains opened
+ * Desc: Uses the top-level domains named package-<n>. psys (platform)
+ *  already includes the packages, and subdomains (core, uncore, dram)
+ *  are counted in their package.
+ ********************************************/
+static int openRapl(struct energy_meter *em)
+{
+  glob_t g;
+  if (glob("/sys/class/powercap/intel-rapl:*/name", 0, NULL, &g) != 0) {
+    return 0;
+  }
+
+  for (size_t k = 0; k < g.gl_pathc; k++) {
+    char name[ENERGY_NAME_LEN], path[256];
+    if (!readFileString(g.gl_pathv[k], name, sizeof(name)) || strncmp(name, "package-", 8) != 0) {
+      continue;
+    }
+    siblingPath(path, sizeof(path), g.gl_pathv[k], "energy_uj");
+    openDomain(em, path, name);
+  }
+
+  globfree(&g);
+  return em->ndomains;
+}
+
+// Labels (or, for unlabelled sensors, hwmon device names) of sensors that
+// measure a whole socket or board rather than one rail of it: amd_energy's
+// per-socket counters, package totals, and the input rail of the ina3221
+// monitors on Jetson boards
+static const char *hwmon_totals[] = {
+  "Esocket", "package", "VDD_IN", "POM_5V_IN"
+};
+
+static bool isTotalSensor(const char *name)
+{
+  for (size_t k = 0; k < sizeof(hwmon_totals) / sizeof(hwmon_totals[0]); k++) {
+    if (strncasecmp(name, hwmon_totals[k], strlen(hwmon_totals[k])) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/*******************************************
+ * Model: openHwmon
+ * Input: sysfs glob pattern of the sensor inputs (energy or power)
+ * Output: Number of sensors opened
+ * Desc: Sensor <kind><m>_input is named by <kind><m>_label, or by its
+ *  device's name if it has no label. Only socket or board totals are
+ *  used, since summing every sensor counts the same power several times;
+ *  a lone sensor is used whatever its name.
+ ********************************************/
+static int openHwmon(struct energy_meter *em, const char *pattern)
+{
+  glob_t g;
+  if (glob(pattern, 0, NULL, &g) != 0) {
+    return 0;
+  }
+
+  char first[ENERGY_NAME_LEN];
+  for (size_t k = 0; k < g.gl_pathc; k++) {
+    char label_path[256], name[ENERGY_NAME_LEN];
+    snprintf(label_path, sizeof(label_path), "%s", g.gl_pathv[k]);
+    char *suffix = strstr(label_path, "_input");
+    if (suffix != NULL) {
+      snprintf(suffix, sizeof(label_path) - (suffix - label_path), "_label");
+    }
+    if (!readFileString(label_path, name, sizeof(name))) {
+      siblingPath(label_path, sizeof(label_path), g.gl_pathv[k], "name");
+      if (!readFileString(label_path, name, sizeof(name))) {
+        snprintf(name, sizeof(name), "%s", strrchr(g.gl_pathv[k], '/') + 1);
+      }
+    }
+    if (k == 0) {
+      snprintf(first, sizeof(first), "%s", name);
+    }
+    if (isTotalSensor(name)) {
+      openDomain(em, g.gl_pathv[k], name);
+    }
+  }
+  if (em->ndomains == 0 && g.gl_pathc == 1) {
+    openDomain(em, g.gl_pathv[0], first);
+  }
+
+  globfree(&g);
+  return em->ndomains;
+}
+
+/*******************************************
+ * Model: energy_init
+ * Input: None
+ * Output: None directly. Initializes em
+ * Desc: Picks the first energy source that is readable, in order RAPL
+ *  package domains, hwmon energy sensors, hwmon power sensors. Within a
+ *  source only sensors that do not overlap are used, see openRapl and
+ *  openHwmon.
+ ********************************************/
+void energy_init(struct energy_meter *em)
+{
+  memset(em, 0, sizeof(*em));
+
+  em->source = ENERGY_RAPL;
+  if (openRapl(em) == 0) {
+    em->source = ENERGY_HWMON_ENERGY;
+    if (openHwmon(em, "/sys/class/hwmon/hwmon*/energy*_input") == 0) {
+      em->source = ENERGY_HWMON_POWER;
+      if (openHwmon(em, "/sys/class/hwmon/hwmon*/power*_input") == 0) {
+        em->source = ENERGY_NONE;
+      }
+    }
+  }
+  em->last_ns = now_ns();
+}
+
+/*******************************************
+ * Model: energy_read_uj
+ * Input: None
+ * Output: Microjoules consumed by all domains since energy_init
+ * Desc: Energy counters are differenced against the previous reading,
+ *  allowing for wraparound. Power sensors are integrated with the
+ *  trapezoid rule, so they are only as accurate as the sampling rate.
+ ********************************************/
+uint64_t energy_read_uj(struct energy_meter *em)
+{
+  if (em->source == ENERGY_NONE) {
+    return 0;
+  }
+
+  uint64_t t = now_ns();
+  for (int d = 0; d < em->ndomains; d++) {
+    uint64_t value = readValue(em->fd[d]);
+
+    if (em->source == ENERGY_HWMON_POWER) {
+      // uW * ns / 1e9 = uJ
+      em->total_uj += (value + em->last[d]) / 2 * (t - em->last_ns) / 1000000000ULL;
+    } else if (value >= em->last[d]) {
+      em->total_uj += value - em->last[d];
+    } else if (em->range[d]) {
+      em->total_uj += em->range[d] - em->last[d] + value;
+    }
+    em->last[d] = value;
+  }
+  em->last_ns = t;
+
+  return em->total_uj;
+}
+
+const char *energy_source_name(struct energy_meter *em)
+{
+  switch (em->source) {
+    case ENERGY_RAPL:
+      return "RAPL powercap";
+    case ENERGY_HWMON_ENERGY:
+      return "hwmon energy sensor";
+    case ENERGY_HWMON_POWER:
+      return "hwmon power sensor (integrated)";
+    default:
+      return "none";
+  }
+}
+
+// Comma-separated names of the domains in use, e.g. "package-0, package-1"
+void energy_describe(struct energy_meter *em, char *buf, size_t len)
+{
+  size_t used = 0;
+  buf[0] = '\0';
+  for (int d = 0; d < em->ndomains && used < len; d++) {
+    int n = snprintf(buf + used, len - used, "%s%s", d ? ", " : "", em->name[d]);
+    if (n < 0) {
+      break;
+    }
+    used += n;
+  }
+}
+
+void energy_close(struct energy_meter *em)
+{
+  for (int d = 0; d < em->ndomains; d++) {
+    close(em->fd[d]);
+  }
+  em->ndomains = 0;
+  em->source = ENERGY_NONE;
+}
+
+double cpufreq_read_hz()
+{
+  // kHz; cpuinfo_cur_freq is the hardware value but is root-only
+  uint64_t khz = readFileValue("/sys/devices/system/cpu/cpu0/cpufreq/cpuinfo_cur_freq");
+  if (khz == 0) {
+    khz = readFileValue("/sys/devices/system/cpu/cpu0/cpufreq/scaling_cur_freq");
+  }
+  return khz * 1000.0;
+}
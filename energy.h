@@ -0,0 +1,49 @@
+#ifndef ENERGY_H
+#define ENERGY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Energy measurement from the kernel's sysfs counters:
+//   RAPL    /sys/class/powercap/intel-rapl:<n>/energy_uj, for the domains
+//           named package-<n> (psys covers the packages too)
+//   hwmon   /sys/class/hwmon/hwmon<n>/energy<m>_input (uJ), or failing
+//           that power<m>_input (uW) integrated over time, as exposed by
+//           the current/power monitors on most ARM boards. Only sensors
+//           whose label (or device name) marks them as a socket or board
+//           total are used, since the others overlap them; a machine
+//           with a single sensor uses that one.
+// When none is readable the source is ENERGY_NONE and callers fall back to
+// the PROC_EPC model. energy_describe lists the sensors that were used.
+
+#define ENERGY_MAX_DOMAINS 8
+#define ENERGY_NAME_LEN 32
+
+enum energy_source {
+  ENERGY_NONE,
+  ENERGY_RAPL,
+  ENERGY_HWMON_ENERGY,
+  ENERGY_HWMON_POWER
+};
+
+struct energy_meter {
+  int source;
+  int ndomains;
+  int fd[ENERGY_MAX_DOMAINS];
+  uint64_t range[ENERGY_MAX_DOMAINS];   // counter wraps at this value (RAPL)
+  uint64_t last[ENERGY_MAX_DOMAINS];    // last raw reading (uJ or uW)
+  uint64_t last_ns;                     // time of the last power reading
+  uint64_t total_uj;                    // energy accumulated since init
+  char name[ENERGY_MAX_DOMAINS][ENERGY_NAME_LEN];  // domain or sensor label
+};
+
+void energy_init(struct energy_meter *em);
+uint64_t energy_read_uj(struct energy_meter *em);
+const char *energy_source_name(struct energy_meter *em);
+void energy_describe(struct energy_meter *em, char *buf, size_t len);
+void energy_close(struct energy_meter *em);
+
+// Current frequency of cpu0 in Hz from cpufreq, or 0 if not exposed
+double cpufreq_read_hz();
+
+#endif
@@ -1,10 +1,12 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <getopt.h>
 #include <string.h>
 #include <locale.h>
 #include <err.h>
 #include "sobel_alg.h"
+#include "metrics.h"
 
 #define EPRINTF(...) fprintf(stderr, __VA_ARGS__)
 struct opts opts;
@@ -17,17 +19,40 @@ void printHelp(int argc, char **argv)
   EPRINTF("OPTS can be a combination of the following:\n");
   EPRINTF("-n <num>  :  Number of frames after which program should quit. Must be a positive integer\n");
   EPRINTF("-m        :  Run the Multi-threaded version\n");
+  EPRINTF("-j <num>  :  Number of worker threads, implies -m. Must be a positive integer (defaults to the autotuned count, else %d with -m)\n", NCORES);
+  EPRINTF("--autotune:  Time thread counts, band heights, fused passes and kernels on synthetic frames of the input's size first,\n");
+  EPRINTF("             and save the fastest to ~/.cache/sobel-autotune/<host> for later runs to pick up\n");
+  EPRINTF("--no-display: Do not show the output, e.g. for benchmarks or hosts without a display\n");
+  EPRINTF("-H <mode> :  Page size for frame buffers: 'thp' (transparent huge pages) or 'huge' (explicit, needs vm.nr_hugepages)\n");
+  EPRINTF("-b <num>  :  Number of frames handed to the workers at once. Must be a positive integer (defaults to 1)\n");
   EPRINTF("-f <file> :  Get input video from file. This is the default (defaults to 'baxter.avi' if unspecified)\n");
+  EPRINTF("             .y4m, .bgr, .bgra and .gray files are memory-mapped and read without decoding (see 'make baxter.y4m')\n");
+  EPRINTF("-l        :  Replay the video file from the start when it runs out, so -n can exceed its length\n");
   EPRINTF("-w        :  Get input video from webcam (if connected to board). Must use either '-w' or '-f', not both\n");
+  EPRINTF("-W        :  Also write the unsaturated 16-bit Sobel magnitude\n");
+  EPRINTF("-t <num>  :  Collect edge statistics, counting pixels whose magnitude is above <num> (0-%d)\n", SOBEL_MAX_MAGNITUDE);
+  EPRINTF("-M <addr> :  Serve Prometheus metrics on 127.0.0.1:<addr>, or on a Unix socket if <addr> starts with '/'\n");
+  EPRINTF("-p <num>  :  Number of pyramid levels (1x, 1/2x, 1/4x) to run Sobel on. Must be 1-%d (defaults to 1)\n", PYR_MAX_LEVELS);
 }
 
 void parseOpts(int argc, char **argv)
 {
   int c;
   int inputSrc = 0;
+  static struct option long_options[] = {
+    {"autotune", no_argument, NULL, 'A'},
+    {"no-display", no_argument, NULL, 'D'},
+    {NULL, 0, NULL, 0}
+  };
   memset(&opts, 0, sizeof(struct opts));
-  while ((c = getopt (argc, argv, "mwn:f:")) != -1) {
+  while ((c = getopt_long (argc, argv, "mwln:f:p:Wt:M:j:b:H:", long_options, NULL)) != -1) {
     switch (c) {
+      case 'A':
+        opts.autotune = 1;
+        break;
+      case 'D':
+        opts.noDisplay = 1;
+        break;
       case 'm':
         opts.multiThreaded = 1;
         break;
@@ -35,6 +60,33 @@ void parseOpts(int argc, char **argv)
         opts.webcam = 1;
         inputSrc++;
         break;
+      case 'l':
+        opts.loop = 1;
+        break;
+      case 'j':
+        opts.multiThreaded = 1;
+        opts.threads = atoi(optarg);
+        if (opts.threads <= 0) {
+          opts.threads = -1;
+        }
+        break;
+      case 'b':
+        opts.batch = atoi(optarg);
+        if (opts.batch <= 0) {
+          opts.batch = -1;
+        }
+        break;
+      case 'H':
+        if (strcmp(optarg, "thp") == 0) {
+          opts.pages = SOBEL_PAGES_THP;
+        } else if (strcmp(optarg, "huge") == 0) {
+          opts.pages = SOBEL_PAGES_HUGETLB;
+        } else {
+          EPRINTF("Invalid page mode: %s (must be thp or huge)\n", optarg);
+          printHelp(argc, argv);
+          exit(-1);
+        }
+        break;
       case 'n':
         opts.numFrames = atoi(optarg);
         break;
@@ -42,8 +94,22 @@ void parseOpts(int argc, char **argv)
         opts.videoFile = optarg;
         inputSrc++;
         break;
+      case 'p':
+        opts.pyrLevels = atoi(optarg);
+        break;
+      case 'W':
+        opts.wideOutput = 1;
+        break;
+      case 'M':
+        opts.metricsAddr = optarg;
+        break;
+      case 't':
+        opts.edgeStats = 1;
+        opts.edgeThreshold = atoi(optarg);
+        break;
       case '?':
-        if (optopt == 'n' || optopt == 'f') {
+        if (optopt == 'n' || optopt == 'f' || optopt == 'p' || optopt == 't' || optopt == 'M' ||
+            optopt == 'j' || optopt == 'b' || optopt == 'H') {
           EPRINTF("Option %c requires an argument\n", optopt);
         }
         else if (isprint(optopt)) {
@@ -65,6 +131,30 @@ void parseOpts(int argc, char **argv)
     printHelp(argc, argv);
     exit(-1);
   }
+  if (opts.pyrLevels == 0) {
+    opts.pyrLevels = 1;
+  } else if (opts.pyrLevels < 0 || opts.pyrLevels > PYR_MAX_LEVELS) {
+    EPRINTF("Invalid number of pyramid levels: %d (must be 1-%d)\n", opts.pyrLevels, PYR_MAX_LEVELS);
+    printHelp(argc, argv);
+    exit(-1);
+  }
+  if (opts.threads < 0) {
+    EPRINTF("Invalid number of threads (must be >0)\n");
+    printHelp(argc, argv);
+    exit(-1);
+  }
+  if (opts.edgeStats && (opts.edgeThreshold < 0 || opts.edgeThreshold > SOBEL_MAX_MAGNITUDE)) {
+    EPRINTF("Invalid edge threshold: %d (must be 0-%d)\n", opts.edgeThreshold, SOBEL_MAX_MAGNITUDE);
+    printHelp(argc, argv);
+    exit(-1);
+  }
+  if (opts.batch == 0) {
+    opts.batch = 1;
+  } else if (opts.batch < 0) {
+    EPRINTF("Invalid batch size (must be >0)\n");
+    printHelp(argc, argv);
+    exit(-1);
+  }
   if (inputSrc == 0) {
     if (opts.videoFile == NULL) {
       opts.videoFile = defaultVideo;
@@ -74,70 +164,24 @@ void parseOpts(int argc, char **argv)
     printHelp(argc, argv);
     exit(-1);
   }
-  return;
-}
-
-int mainSingleThread()
-{
-  runSobelST();
-  return 0;
-}
-
-// This mutex will be used to allow threads to contest for thread 0 status
-pthread_barrier_t endSobel;
-pthread_barrier_t grayscale_barrier, sobel_barrier; // display_barrier;     // declaring barriers for part 2
-pthread_mutex_t thread0 = PTHREAD_MUTEX_INITIALIZER;
-pthread_t thread0_id = 0;
-int mainMultiThread()
-{
-  // Thread variables
-  pthread_t sobel1, sobel2;
-
-  // Set up a barrier to synchronize both threads at the end of runSobel
-  pthread_barrier_init(&endSobel, NULL, 2);
-
-  // new barriers for part 2
-  pthread_barrier_init(&grayscale_barrier, NULL, 2);
-  pthread_barrier_init(&sobel_barrier, NULL, 2);
-  // pthread_barrier_init(&display_barrier, NULL, 2);     // not being used rn
-
-  // Call threads
-  int ret;
-  if ( (ret = pthread_create( &sobel1, NULL, runSobelMT, NULL)) ){
-    printf("Thread creation failed: %d\n", ret);
-    exit(1);
-  }
-  if ( (ret = pthread_create( &sobel2, NULL, runSobelMT, NULL)) ){
-    printf("Thread creation failed: %d\n", ret);
-    exit(1);
+  if (opts.loop && opts.webcam) {
+    EPRINTF("-l only applies to video files\n");
+    printHelp(argc, argv);
+    exit(-1);
   }
-
-  // Wait for them to finish
-  pthread_join(sobel1, NULL);
-  pthread_join(sobel2, NULL);
-
-  // Destroy the barriers including new ones for part 2
-  pthread_barrier_destroy(&endSobel);
-  pthread_barrier_destroy(&grayscale_barrier);
-  pthread_barrier_destroy(&sobel_barrier);
-  // pthread_barrier_destroy(&display_barrier);
-
-  // Return ok if sobel returns correctly
-  return 0;
+  return;
 }
 
 int main(int argc, char **argv)
 {
   parseOpts(argc, argv);
 
-  if (opts.multiThreaded == 0) {
-    mainSingleThread();
-  }
-  else if (opts.multiThreaded == 1) {
-    mainMultiThread();
-  }
-  else {  // Invalid argument
-   fprintf(stderr,"Usage: %s [-m]\n",argv[0]);
+  if (opts.metricsAddr) {
+    metrics_start(opts.metricsAddr);
   }
+
+  runSobel();
+
+  metrics_stop();
   return 0;
 }
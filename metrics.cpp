@@ -0,0 +1,273 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <err.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <string>
+#include <vector>
+
+#include "metrics.h"
+
+struct metrics_thread *metrics_threads;
+static int metrics_nthreads;
+int metrics_queues[NUM_QUEUES];
+
+static const char *stage_names[NUM_STAGES] = {"capture", "gray", "sobel", "display"};
+static const char *queue_names[NUM_QUEUES] = {"capture", "display"};
+
+static int listen_fd = -1;
+static pthread_t server_thread;
+static volatile bool server_stop = false;
+static struct sockaddr_un unix_addr;
+
+static uint64_t load(const uint64_t *counter)
+{
+  return __atomic_load_n(counter, __ATOMIC_RELAXED);
+}
+
+static void appendf(std::string& out, const char *fmt, ...)
+{
+  char line[256];
+  va_list ap;
+  va_start(ap, fmt);
+  vsnprintf(line, sizeof(line), fmt, ap);
+  va_end(ap);
+  out += line;
+}
+
+// A thread is exported once it has timed a stage
+static bool active(int t)
+{
+  for (int s = 0; s < NUM_STAGES; s++) {
+    for (int b = 0; b <= METRICS_BUCKETS; b++) {
+      if (load(&metrics_threads[t].stage_hist[s][b])) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+/*******************************************
+ * Model: metrics_init
+ * Input: Number of workers
+ * Output: None
+ * Desc: The slots are cache line aligned so workers never share a line,
+ *  and live for the rest of the process since the server may read them
+ *  at any time. The count is published last, so a scrape sees either no
+ *  slots or all of them zeroed.
+ ********************************************/
+void metrics_init(int nthreads)
+{
+  void *slots;
+  if (posix_memalign(&slots, 64, nthreads * sizeof(struct metrics_thread))) {
+    errx(1, "cannot allocate metrics for %d threads", nthreads);
+  }
+  memset(slots, 0, nthreads * sizeof(struct metrics_thread));
+  metrics_threads = (struct metrics_thread *)slots;
+  __atomic_store_n(&metrics_nthreads, nthreads, __ATOMIC_RELEASE);
+}
+
+/*******************************************
+ * Model: renderMetrics
+ * Input: None
+ * Output: Prometheus text exposition of every thread that has recorded
+ * Desc: Reads each counter once with a relaxed load. Counters of one thread
+ *  may be from slightly different frames, which is fine for scraping.
+ ********************************************/
+static std::string renderMetrics()
+{
+  std::string out;
+  int nthreads = __atomic_load_n(&metrics_nthreads, __ATOMIC_ACQUIRE);
+  std::vector<bool> is_active(nthreads);
+  for (int t = 0; t < nthreads; t++) {
+    is_active[t] = active(t);
+  }
+
+  // Each frame is counted once, by the driver, however many workers share it
+  uint64_t frames = 0;
+  for (int t = 0; t < nthreads; t++) {
+    frames += load(&metrics_threads[t].frames);
+  }
+  out += "# HELP sobel_frames_total Frames completed.\n";
+  out += "# TYPE sobel_frames_total counter\n";
+  appendf(out, "sobel_frames_total %llu\n", (unsigned long long)frames);
+
+  out += "# HELP sobel_worker_frames_total Frames each worker has done its bands of; every worker counts every frame.\n";
+  out += "# TYPE sobel_worker_frames_total counter\n";
+  for (int t = 0; t < nthreads; t++) {
+    if (is_active[t]) {
+      appendf(out, "sobel_worker_frames_total{thread=\"%d\"} %llu\n", t,
+              (unsigned long long)load(&metrics_threads[t].worker_frames));
+    }
+  }
+
+  out += "# HELP sobel_dropped_frames_total Frames lost before processing.\n";
+  out += "# TYPE sobel_dropped_frames_total counter\n";
+  for (int t = 0; t < nthreads; t++) {
+    if (is_active[t]) {
+      appendf(out, "sobel_dropped_frames_total{thread=\"%d\"} %llu\n", t,
+              (unsigned long long)load(&metrics_threads[t].dropped));
+    }
+  }
+
+  out += "# HELP sobel_stage_seconds Wall time spent per stage per frame.\n";
+  out += "# TYPE sobel_stage_seconds histogram\n";
+  for (int t = 0; t < nthreads; t++) {
+    if (!is_active[t]) continue;
+    for (int s = 0; s < NUM_STAGES; s++) {
+      uint64_t cumulative = 0;
+      for (int b = 0; b < METRICS_BUCKETS; b++) {
+        cumulative += load(&metrics_threads[t].stage_hist[s][b]);
+        appendf(out, "sobel_stage_seconds_bucket{thread=\"%d\",stage=\"%s\",le=\"%g\"} %llu\n",
+                t, stage_names[s], (1 << b) * 1e-6, (unsigned long long)cumulative);
+      }
+      cumulative += load(&metrics_threads[t].stage_hist[s][METRICS_BUCKETS]);
+      appendf(out, "sobel_stage_seconds_bucket{thread=\"%d\",stage=\"%s\",le=\"+Inf\"} %llu\n",
+              t, stage_names[s], (unsigned long long)cumulative);
+      appendf(out, "sobel_stage_seconds_sum{thread=\"%d\",stage=\"%s\"} %.9f\n",
+              t, stage_names[s], load(&metrics_threads[t].stage_ns[s]) * 1e-9);
+      appendf(out, "sobel_stage_seconds_count{thread=\"%d\",stage=\"%s\"} %llu\n",
+              t, stage_names[s], (unsigned long long)cumulative);
+    }
+  }
+
+  out += "# HELP sobel_stage_cycles_total CPU cycles spent per stage (0 without perf counters).\n";
+  out += "# TYPE sobel_stage_cycles_total counter\n";
+  for (int t = 0; t < nthreads; t++) {
+    if (!is_active[t]) continue;
+    for (int s = 0; s < NUM_STAGES; s++) {
+      appendf(out, "sobel_stage_cycles_total{thread=\"%d\",stage=\"%s\"} %llu\n",
+              t, stage_names[s], (unsigned long long)load(&metrics_threads[t].stage_cycles[s]));
+    }
+  }
+
+  out += "# HELP sobel_stage_dtlb_misses_total Data TLB misses per stage (0 without perf counters).\n";
+  out += "# TYPE sobel_stage_dtlb_misses_total counter\n";
+  for (int t = 0; t < nthreads; t++) {
+    if (!is_active[t]) continue;
+    for (int s = 0; s < NUM_STAGES; s++) {
+      appendf(out, "sobel_stage_dtlb_misses_total{thread=\"%d\",stage=\"%s\"} %llu\n",
+              t, stage_names[s], (unsigned long long)load(&metrics_threads[t].stage_dtlb_misses[s]));
+    }
+  }
+
+  out += "# HELP sobel_queue_depth Frames waiting in each queue.\n";
+  out += "# TYPE sobel_queue_depth gauge\n";
+  for (int q = 0; q < NUM_QUEUES; q++) {
+    appendf(out, "sobel_queue_depth{queue=\"%s\"} %d\n", queue_names[q],
+            __atomic_load_n(&metrics_queues[q], __ATOMIC_RELAXED));
+  }
+
+  return out;
+}
+
+/*******************************************
+ * Model: serveMetrics
+ * Input: None
+ * Output: None
+ * Desc: Server thread. Answers every connection with a minimal HTTP/1.0
+ *  response so both Prometheus and curl (--unix-socket) can scrape it.
+ ********************************************/
+static void *serveMetrics(void *ptr)
+{
+  while (!server_stop) {
+    int fd = accept(listen_fd, NULL, NULL);
+    if (fd < 0) {
+      if (errno == EINTR) continue;
+      break;
+    }
+
+    // Don't let a stalled client hold up the next scrape
+    struct timeval timeout = {1, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    // The request itself does not matter; read what has arrived and answer
+    char request[1024];
+    if (recv(fd, request, sizeof(request), 0) < 0) {
+      close(fd);
+      continue;
+    }
+
+    std::string body = renderMetrics();
+    char header[128];
+    int header_len = snprintf(header, sizeof(header),
+                              "HTTP/1.0 200 OK\r\n"
+                              "Content-Type: text/plain; version=0.0.4\r\n"
+                              "Content-Length: %zu\r\n\r\n", body.size());
+    send(fd, header, header_len, MSG_NOSIGNAL);
+    send(fd, body.data(), body.size(), MSG_NOSIGNAL);
+    close(fd);
+  }
+  return NULL;
+}
+
+void metrics_start(const char *addr)
+{
+  server_stop = false;
+  memset(&unix_addr, 0, sizeof(unix_addr));
+  if (addr[0] == '/') {
+    unix_addr.sun_family = AF_UNIX;
+    if (strlen(addr) >= sizeof(unix_addr.sun_path)) {
+      errx(1, "metrics socket path too long: %s", addr);
+    }
+    strcpy(unix_addr.sun_path, addr);
+    unlink(addr);
+
+    listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd < 0 || bind(listen_fd, (struct sockaddr *)&unix_addr, sizeof(unix_addr)) < 0) {
+      err(1, "metrics socket %s", addr);
+    }
+  } else {
+    struct sockaddr_in in_addr;
+    memset(&in_addr, 0, sizeof(in_addr));
+    in_addr.sin_family = AF_INET;
+    in_addr.sin_port = htons(atoi(addr));
+    in_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    int one = 1;
+    listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (listen_fd >= 0) {
+      setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    }
+    if (listen_fd < 0 || bind(listen_fd, (struct sockaddr *)&in_addr, sizeof(in_addr)) < 0) {
+      err(1, "metrics port %s", addr);
+    }
+  }
+
+  if (listen(listen_fd, 4) < 0) {
+    err(1, "metrics listen");
+  }
+
+  int ret;
+  if ((ret = pthread_create(&server_thread, NULL, serveMetrics, NULL))) {
+    errx(1, "Metrics thread creation failed: %d", ret);
+  }
+}
+
+void metrics_stop()
+{
+  if (listen_fd < 0) {
+    return;
+  }
+
+  // Wake the server out of accept()
+  server_stop = true;
+  shutdown(listen_fd, SHUT_RDWR);
+  pthread_join(server_thread, NULL);
+  close(listen_fd);
+  listen_fd = -1;
+
+  if (unix_addr.sun_path[0]) {
+    unlink(unix_addr.sun_path);
+  }
+}
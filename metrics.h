@@ -0,0 +1,99 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdint.h>
+#include <time.h>
+
+// Per-thread counters exported in Prometheus text format. Each thread only
+// writes its own slot with relaxed atomic stores, and the server thread only
+// reads them, so recording never takes a lock and a scrape never stalls the
+// frame loop. There is one slot per worker, allocated by metrics_init once
+// the worker count is known.
+
+// Stage time histogram buckets: le = 1us, 2us, 4us ... 2^15us (~33ms), +Inf
+#define METRICS_BUCKETS 16
+
+enum metrics_stage {
+  STAGE_CAPTURE,
+  STAGE_GRAY,
+  STAGE_SOBEL,
+  STAGE_DISPLAY,
+  NUM_STAGES
+};
+
+enum metrics_queue {
+  QUEUE_CAPTURE,    // captured frames not yet picked up by the workers
+  QUEUE_DISPLAY,    // finished frames not yet picked up by the display sink
+  NUM_QUEUES
+};
+
+struct metrics_thread {
+  uint64_t frames;          // frames completed, only counted by the driver
+  uint64_t worker_frames;   // frames this worker has done its bands of
+  uint64_t dropped;
+  uint64_t stage_ns[NUM_STAGES];
+  uint64_t stage_cycles[NUM_STAGES];
+  uint64_t stage_dtlb_misses[NUM_STAGES];
+  uint64_t stage_hist[NUM_STAGES][METRICS_BUCKETS + 1];
+} __attribute__((aligned(64)));
+
+extern struct metrics_thread *metrics_threads;
+extern int metrics_queues[NUM_QUEUES];
+
+// Allocate the slots of nthreads workers. Call once, before recording;
+// the server may already be running and picks them up.
+void metrics_init(int nthreads);
+
+// Start serving on a Unix socket (addr starting with '/') or on
+// 127.0.0.1:<addr>. Returns immediately; the server runs on its own thread.
+void metrics_start(const char *addr);
+void metrics_stop();
+
+static inline uint64_t metrics_now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Single writer per slot: a plain load plus an atomic store is enough
+static inline void metrics_add(uint64_t *counter, uint64_t n)
+{
+  __atomic_store_n(counter, *counter + n, __ATOMIC_RELAXED);
+}
+
+static inline void metrics_frames(int tid, int n)
+{
+  metrics_add(&metrics_threads[tid].frames, n);
+}
+
+static inline void metrics_worker_frame(int tid)
+{
+  metrics_add(&metrics_threads[tid].worker_frames, 1);
+}
+
+static inline void metrics_dropped(int tid)
+{
+  metrics_add(&metrics_threads[tid].dropped, 1);
+}
+
+static inline void metrics_stage(int tid, int stage, uint64_t ns, uint64_t cycles,
+                                 uint64_t dtlb_misses)
+{
+  struct metrics_thread *t = &metrics_threads[tid];
+  int b = 0;
+  while (b < METRICS_BUCKETS && ns > (1000ULL << b)) {
+    b++;
+  }
+  metrics_add(&t->stage_hist[stage][b], 1);
+  metrics_add(&t->stage_ns[stage], ns);
+  metrics_add(&t->stage_cycles[stage], cycles);
+  metrics_add(&t->stage_dtlb_misses[stage], dtlb_misses);
+}
+
+static inline void metrics_queue_depth(int queue, int depth)
+{
+  __atomic_store_n(&metrics_queues[queue], depth, __ATOMIC_RELAXED);
+}
+
+#endif
@@ -21,6 +21,7 @@
 // Setup the counters and populate the counters struct with their data
 void pc_init(counters_t *counters, int pid)
 {
+  counters->dtlb_misses.fd = -1;
 
 #ifndef __arm__
   return;
@@ -97,6 +98,23 @@ void pc_init(counters_t *counters, int pid)
   if (counters->ic.fd < 0) {
     err(1, "Instruction count: cannot create event");
   }
+
+  // dTLB misses are optional: not every core maps the generic event
+  memset(&counters->dtlb_misses.attr, 0, sizeof(counters->dtlb_misses.attr));
+  memset(&counters->dtlb_misses.arg, 0, sizeof(counters->dtlb_misses.arg));
+  counters->dtlb_misses.count = 0;
+  counters->dtlb_misses.arg.size = sizeof(counters->dtlb_misses.arg);
+  counters->dtlb_misses.arg.attr = &counters->dtlb_misses.attr;
+  counters->dtlb_misses.fd = -1;
+  ret = pfm_get_os_event_encoding("dtlb-load-misses", PFM_PLM0|PFM_PLM3, PFM_OS_PERF_EVENT, &counters->dtlb_misses.arg);
+  if (ret == PFM_SUCCESS) {
+    counters->dtlb_misses.attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    counters->dtlb_misses.attr.disabled = 1;
+    counters->dtlb_misses.fd = perf_event_open(&counters->dtlb_misses.attr, pid, -1, -1, 0);
+  }
+  if (counters->dtlb_misses.fd < 0) {
+    warnx("dTLB misses: no counter on this core, reporting 0");
+  }
   return;
 #endif
 }
@@ -106,6 +124,7 @@ void pc_start(counters_t *counters)
   counters->cycles.count = 0;
   counters->l1_misses.count = 0;
   counters->ic.count = 0;
+  counters->dtlb_misses.count = 0;
 
 #ifndef __arm__
   return;
@@ -141,6 +160,11 @@ void pc_start(counters_t *counters)
   if (ret) {
     err(1, "ioctl(enable) failed");
   }
+
+  if (counters->dtlb_misses.fd >= 0) {
+    ioctl(counters->dtlb_misses.fd, PERF_EVENT_IOC_RESET, 0);
+    ioctl(counters->dtlb_misses.fd, PERF_EVENT_IOC_ENABLE, 0);
+  }
   return;
 #endif
 }
@@ -182,6 +206,18 @@ void pc_stop(counters_t *counters)
   else {
     counters->ic.count = (uint64_t)counters->ic.values[0];
   }
+
+  if (counters->dtlb_misses.fd >= 0) {
+    ioctl(counters->dtlb_misses.fd, PERF_EVENT_IOC_DISABLE, 0);
+    read(counters->dtlb_misses.fd, counters->dtlb_misses.values, sizeof(counters->dtlb_misses.values));
+    if (counters->dtlb_misses.values[2]) {
+      counters->dtlb_misses.count = (uint64_t)((double)counters->dtlb_misses.values[0] *
+                                               counters->dtlb_misses.values[1]/counters->dtlb_misses.values[2]);
+    }
+    else {
+      counters->dtlb_misses.count = (uint64_t)counters->dtlb_misses.values[0];
+    }
+  }
   return;
 #endif
 }
@@ -21,6 +21,7 @@ struct counters_t{
   perf_counter_t cycles;
   perf_counter_t l1_misses;
   perf_counter_t ic;
+  perf_counter_t dtlb_misses;   // fd < 0 if the core does not expose it
 };
 
 
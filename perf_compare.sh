@@ -0,0 +1,98 @@
+#!/bin/sh
+# Builds each variant in PERF_VARIANTS, runs the benchmark workload on all
+# of them in turn (so drift in clocks or temperature hits every variant
+# alike) and reports the best frames per second of BENCH_RUNS runs next to
+# the first variant's. Run through make perf-compare, which sets the
+# variables below from the Makefile.
+set -e
+
+MAKE=${MAKE:-make}
+CC=${CC:-g++}
+EXECUTABLE=${EXECUTABLE:-sobel}
+BENCH_INPUT=${BENCH_INPUT:-baxter.bgr}
+BENCH_FRAMES=${BENCH_FRAMES:-300}
+BENCH_THREADS=${BENCH_THREADS:-$(nproc)}
+BENCH_RUNS=${BENCH_RUNS:-3}
+BENCH_DIR=${BENCH_DIR:-bench}
+PERF_VARIANTS=${PERF_VARIANTS:-"release native lto pgo native-lto-pgo"}
+
+mkdir -p "$BENCH_DIR"
+
+for variant in $PERF_VARIANTS; do
+  flags=""
+  target=$EXECUTABLE
+  for part in $(echo "$variant" | tr - ' '); do
+    case $part in
+      release) ;;
+      native) flags="$flags NATIVE=1" ;;
+      lto) flags="$flags LTO=1" ;;
+      pgo) target=pgo ;;
+      *) echo "perf_compare: unknown part '$part' in variant $variant" >&2; exit 1 ;;
+    esac
+  done
+  echo "== building $variant"
+  $MAKE $flags $target
+  cp "$EXECUTABLE" "$BENCH_DIR/$EXECUTABLE-$variant"
+done
+
+modes="st"
+if [ "$BENCH_THREADS" -gt 1 ]; then
+  modes="st mt"
+fi
+
+results="$BENCH_DIR/results.csv"
+echo "variant,mode,run,fps" > "$results"
+run=1
+while [ "$run" -le "$BENCH_RUNS" ]; do
+  for variant in $PERF_VARIANTS; do
+    for mode in $modes; do
+      threads=1
+      if [ "$mode" = mt ]; then
+        threads=$BENCH_THREADS
+      fi
+      log="$BENCH_DIR/$variant-$mode-$run.log"
+      echo "== run $run/$BENCH_RUNS: $variant, $threads threads"
+      rm -f st_perf.csv mt_perf.csv
+      if ! "./$BENCH_DIR/$EXECUTABLE-$variant" -f "$BENCH_INPUT" -n "$BENCH_FRAMES" -l --no-display -j "$threads" > "$log" 2>&1; then
+        echo "perf_compare: $variant failed, see $log" >&2
+        exit 1
+      fi
+      fps=$(cat st_perf.csv mt_perf.csv 2>/dev/null | sed -n 's/^Frames per second, *//p')
+      echo "$variant,$mode,$run,$fps" >> "$results"
+    done
+  done
+  run=$((run + 1))
+done
+
+report="$BENCH_DIR/perf-compare.txt"
+{
+  echo "# $(uname -n) $(uname -m), $($CC --version | head -n 1)"
+  echo "# $BENCH_INPUT, $BENCH_FRAMES frames, best of $BENCH_RUNS runs, mt = $BENCH_THREADS threads"
+  awk -F, -v variants="$PERF_VARIANTS" -v modes="$modes" '
+    NR > 1 && $4 != "" {
+      key = $1 "," $2
+      if (!(key in best) || $4 + 0 > best[key]) best[key] = $4 + 0
+    }
+    END {
+      nv = split(variants, v, " ")
+      nm = split(modes, m, " ")
+      line = sprintf("%-16s", "variant")
+      for (j = 1; j <= nm; j++) line = line sprintf(" %10s %8s", m[j] " fps", "delta")
+      print line
+      for (i = 1; i <= nv; i++) {
+        line = sprintf("%-16s", v[i])
+        for (j = 1; j <= nm; j++) {
+          key = v[i] "," m[j]
+          base = v[1] "," m[j]
+          if (!(key in best)) {
+            line = line sprintf(" %10s %8s", "-", "-")
+          } else if (!(base in best) || best[base] == 0) {
+            line = line sprintf(" %10.1f %8s", best[key], "-")
+          } else {
+            line = line sprintf(" %10.1f %+7.1f%%", best[key], (best[key] / best[base] - 1) * 100)
+          }
+        }
+        print line
+      }
+    }' "$results"
+} | tee "$report"
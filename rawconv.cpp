@@ -0,0 +1,90 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <err.h>
+
+#include "opencv2/highgui/highgui.hpp"
+#include "sobel_alg.h"
+
+#define EPRINTF(...) fprintf(stderr, __VA_ARGS__)
+
+/*******************************************
+ * rawconv: decodes a video once (e.g. baxter.avi) into an uncompressed
+ * file that the sobel driver can memory-map with -f:
+ *   .y4m   YUV4MPEG2 Cmono, luma computed with grayScale so it matches
+ *          what the pipeline would have produced
+ *   .bgr   raw packed BGR frames, exactly as decoded
+ *   .bgra  raw packed BGRA frames (alpha 255), like a capture card's
+ *   .gray  raw 8-bit frames, luma computed with grayScale
+ ********************************************/
+int main(int argc, char **argv)
+{
+  if (argc < 3 || argc > 4) {
+    EPRINTF("Usage: %s <input video> <output.y4m|.bgr|.bgra|.gray> [max frames]\n", argv[0]);
+    exit(-1);
+  }
+  const char *in_file = argv[1];
+  const char *out_file = argv[2];
+  long max_frames = (argc == 4) ? atol(argv[3]) : -1;
+
+  const char *ext = strrchr(out_file, '.');
+  bool to_y4m = ext && strcmp(ext, ".y4m") == 0;
+  bool to_bgr = ext && strcmp(ext, ".bgr") == 0;
+  bool to_bgra = ext && strcmp(ext, ".bgra") == 0;
+  bool to_gray = ext && strcmp(ext, ".gray") == 0;
+  if (!to_y4m && !to_bgr && !to_bgra && !to_gray) {
+    errx(1, "%s: output must end in .y4m, .bgr, .bgra or .gray", out_file);
+  }
+
+  CvCapture *cap = cvCreateFileCapture(in_file);
+  if (cap == NULL) {
+    errx(1, "cannot open video %s", in_file);
+  }
+  FILE *out = fopen(out_file, "wb");
+  if (out == NULL) {
+    err(1, "%s", out_file);
+  }
+
+  if (to_y4m) {
+    double fps = cvGetCaptureProperty(cap, CV_CAP_PROP_FPS);
+    int fps_num = (fps > 0) ? (int)(fps * 1000 + 0.5) : 30000;
+    fprintf(out, "YUV4MPEG2 W%d H%d F%d:1000 Ip A1:1 Cmono\n", IMG_WIDTH, IMG_HEIGHT, fps_num);
+  }
+
+  Mat gray(IMG_HEIGHT, IMG_WIDTH, CV_8UC1);
+  Mat bgra;
+  long n = 0;
+  IplImage *img;
+  while ((max_frames < 0 || n < max_frames) && (img = cvQueryFrame(cap)) != NULL) {
+    Mat frame = img;
+    if (frame.cols != IMG_WIDTH || frame.rows != IMG_HEIGHT || frame.channels() != 3) {
+      errx(1, "%s: frame %ld is %dx%dx%d, expected %dx%dx3", in_file, n,
+           frame.cols, frame.rows, frame.channels(), IMG_WIDTH, IMG_HEIGHT);
+    }
+
+    if (to_bgr) {
+      for (int r = 0; r < frame.rows; r++) {
+        fwrite(frame.ptr(r), 1, frame.cols * 3, out);
+      }
+    } else if (to_bgra) {
+      cvtColor(frame, bgra, CV_BGR2BGRA);
+      for (int r = 0; r < bgra.rows; r++) {
+        fwrite(bgra.ptr(r), 1, bgra.cols * 4, out);
+      }
+    } else {
+      grayScale(frame, gray, 0, frame.rows);
+      if (to_y4m) {
+        fputs("FRAME\n", out);
+      }
+      fwrite(gray.data, 1, (size_t)IMG_WIDTH * IMG_HEIGHT, out);
+    }
+    n++;
+  }
+
+  if (fclose(out) != 0) {
+    err(1, "%s", out_file);
+  }
+  cvReleaseCapture(&cap);
+  printf("Wrote %ld frames to %s\n", n, out_file);
+  return 0;
+}
@@ -0,0 +1,218 @@
+#ifndef SOBEL_H
+#define SOBEL_H
+
+// libsobel: NEON grayscale + Sobel kernels and a context object that owns
+// the worker threads and frame buffers needed to run them on a stream.
+// The library never exits the process: failures are returned to the caller
+// (see SobelContext::error).
+
+#include <pthread.h>
+#include "opencv2/imgproc/imgproc.hpp"
+
+// Gray/Sobel levels emitted by pyramid mode (1x, 1/2x, 1/4x)
+#define PYR_MAX_LEVELS 3
+// Edge statistics gathered by sobelCalc. |Gx|+|Gy| is at most 2040, so
+// 64 histogram bins of width 32 cover the full range, and thresholds are
+// 0..SOBEL_MAX_MAGNITUDE
+#define SOBEL_MAX_MAGNITUDE 2040
+#define SOBEL_HIST_BINS 64
+#define SOBEL_HIST_SHIFT 5
+// Tiles are multiples of 8 wide so a vector never straddles two tiles
+#define SOBEL_TILE_W 80
+#define SOBEL_TILE_H 80
+// Largest frame the tile grid of sobel_stats can cover
+#define SOBEL_MAX_WIDTH 1920
+#define SOBEL_MAX_HEIGHT 1080
+#define SOBEL_TILES_X ((SOBEL_MAX_WIDTH + SOBEL_TILE_W - 1) / SOBEL_TILE_W)
+#define SOBEL_TILES_Y ((SOBEL_MAX_HEIGHT + SOBEL_TILE_H - 1) / SOBEL_TILE_H)
+
+// Gradient magnitude statistics for one tile (or the whole frame)
+struct sobel_tile_stats {
+  unsigned int hist[SOBEL_HIST_BINS];
+  unsigned int sum;
+  unsigned int count;   // pixels with magnitude > threshold
+};
+
+// Per-frame statistics of a Sobel output. Only the first tiles_y x tiles_x
+// tiles are used. Tile columns start at column 1 to line up with the
+// vector loop.
+struct sobel_stats {
+  int threshold;
+  int tiles_x, tiles_y;
+  struct sobel_tile_stats frame;
+  struct sobel_tile_stats tiles[SOBEL_TILES_Y][SOBEL_TILES_X];
+};
+
+// Channel order of input frames
+enum sobel_order {
+  SOBEL_BGR,
+  SOBEL_RGB,
+  SOBEL_BGRA,
+  SOBEL_GRAY
+};
+
+// Kernel variants: the ones specialized for common widths, or the generic
+// ones for every width
+enum sobel_kernels {
+  SOBEL_KERNELS_SPECIALIZED,
+  SOBEL_KERNELS_GENERIC
+};
+
+// Kernels. Each works on rows start..end of its images so callers can
+// split a frame into bands. The grayscale kernels take 1 and 4 channel
+// images as gray and BGRA; order only picks between SOBEL_BGR and
+// SOBEL_RGB for 3 channel images.
+void sobelCalc(cv::Mat& img_gray, cv::Mat& img_sobel_out, int start, int end,
+               cv::Mat* img_sobel16_out = NULL, struct sobel_stats* stats = NULL,
+               int kernels = SOBEL_KERNELS_SPECIALIZED);
+int sobelStatsReset(struct sobel_stats* stats, int threshold, int rows, int cols);
+void sobelStatsReduce(struct sobel_stats* stats);
+void grayScale(cv::Mat& img, cv::Mat& img_gray_out, int start, int end, int order = SOBEL_BGR,
+               int kernels = SOBEL_KERNELS_SPECIALIZED);
+void grayScalePyramid(cv::Mat& img, cv::Mat img_gray_out[], int nlevels, int start, int end,
+                      int order = SOBEL_BGR, int kernels = SOBEL_KERNELS_SPECIALIZED);
+void pyrDown2x(cv::Mat& img_in, cv::Mat& img_out, int start, int end);
+
+// Frame buffers. Rows of every buffer start on a SOBEL_ALIGN (cache line)
+// boundary, with the stride padded to match. Buffers are carved out of an
+// arena that can be backed by huge pages to cut TLB misses on large or
+// many frames. sobelArenaInit returns -1 with errno set if the memory
+// cannot be mapped; sobelArenaMat returns an empty Mat once the arena is
+// used up.
+#define SOBEL_ALIGN 64
+
+enum sobel_pages {
+  SOBEL_PAGES_DEFAULT,  // whatever the kernel's THP policy gives
+  SOBEL_PAGES_THP,      // 2MB aligned and madvise(MADV_HUGEPAGE)
+  SOBEL_PAGES_HUGETLB   // MAP_HUGETLB, from the vm.nr_hugepages pool
+};
+
+struct sobel_arena {
+  unsigned char *base;
+  size_t len, used;
+  int pages;            // page mode actually obtained
+};
+
+size_t sobelFrameStride(int cols, int type);
+size_t sobelFrameBytes(int rows, int cols, int type);
+int sobelArenaInit(struct sobel_arena *arena, size_t bytes, int pages);
+cv::Mat sobelArenaMat(struct sobel_arena *arena, int rows, int cols, int type);
+void sobelArenaFree(struct sobel_arena *arena);
+const char *sobelPagesName(int pages);
+
+// Stages reported to a sobel_stage_hook
+enum sobel_stage {
+  SOBEL_STAGE_GRAY,
+  SOBEL_STAGE_SOBEL
+};
+
+// Called by every worker around each stage of each frame (begin = 1 before,
+// 0 after), on that worker's thread. Worker 0 is the thread that called
+// process/process_batch.
+typedef void (*sobel_stage_hook)(void *arg, int worker, int stage, int begin);
+
+struct sobel_config {
+  int width, height;    // frame geometry, no default
+  int threads;          // workers, including the calling thread
+  int order;            // SOBEL_BGR or SOBEL_RGB, for 3 channel frames
+  int pyr_levels;       // 1..PYR_MAX_LEVELS
+  int wide_output;      // also produce the unsaturated 16-bit magnitude
+  int edge_stats;       // collect sobel_stats
+  int edge_threshold;
+  int pages;            // SOBEL_PAGES_* for the output buffers
+
+  // Scheduling, see SobelContext. The defaults suit most machines; the
+  // demo's --autotune picks them per host.
+  int band_rows;        // 0: one band per worker, else bands dealt out in turn
+  int fused;            // Sobel each band right after its gray conversion
+  int kernels;          // SOBEL_KERNELS_*
+};
+
+void sobelConfigInit(struct sobel_config *config);
+
+// Outputs of one frame. Owned by the context and valid until the next
+// process/process_batch call.
+struct sobel_result {
+  cv::Mat gray[PYR_MAX_LEVELS];
+  cv::Mat sobel[PYR_MAX_LEVELS];
+  cv::Mat sobel16;
+  struct sobel_stats stats;
+
+  cv::Mat gray_buf;     // level 0 gray, unless the frame is gray already
+};
+
+/*******************************************
+ * SobelContext
+ * Runs grayscale + Sobel on 3, 4 or single channel frames of the configured
+ * size. The frame is split into horizontal bands: one per worker, or of
+ * band_rows rows each, dealt out to the workers in turn. A batch is handed
+ * to the workers with a single wake-up and a single completion barrier; in
+ * between, the workers only meet once per frame, between the gray and
+ * Sobel stages. Each frame of a batch has its own buffers, so a worker may
+ * run ahead into the next frame while others finish this one.
+ * A context whose configuration is invalid, or that cannot get its threads
+ * or buffers, has error() set and returns NULL from every process call.
+ * process/process_batch also return NULL, with error() set, for frames
+ * that do not match the configuration; the context stays usable.
+ * When fused, the Sobel rows of a band that only need that band's gray
+ * rows are done right after them, while they are still in cache, and just
+ * the first and last row of each band are left for after the barrier.
+ * The gray stage reported to the hook then includes those Sobel rows.
+ ********************************************/
+class SobelContext {
+public:
+  SobelContext(const struct sobel_config& config);
+  ~SobelContext();
+
+  struct sobel_result* process(cv::Mat& frame);
+  struct sobel_result* process_batch(cv::Mat frames[], int count);
+  const char *error() const { return err; }
+
+  void set_stage_hook(sobel_stage_hook hook, void *arg);
+  const struct sobel_config& config() const { return cfg; }
+  int pages() const { return arena.pages; }
+
+private:
+  struct worker_arg {
+    SobelContext *ctx;
+    int index;
+  };
+
+  static void *workerMain(void *ptr);
+  int bandRow(int worker) const;
+  bool band(int worker, int index, int *start, int *end) const;
+  void sobelLevel(struct sobel_result& r, int level, int start, int end);
+  void runBatch(int worker);
+  bool reserve(int count);
+  bool setError(const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+  struct sobel_config cfg;
+  bool ready;           // constructed successfully
+  const char *err;
+  char err_buf[160];
+
+  pthread_t *threads;
+  struct worker_arg *args;
+  int started;          // workers created, including worker 0
+  bool sync_init;
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+  pthread_barrier_t stage_barrier, done_barrier;
+  unsigned int generation;
+  bool quit;
+
+  cv::Mat *batch_frames;
+  int batch_count;
+  struct sobel_result *results;
+  int results_cap;
+  struct sobel_arena arena;
+
+  sobel_stage_hook hook;
+  void *hook_arg;
+
+  // Not copyable: owns threads
+  SobelContext(const SobelContext&);
+  SobelContext& operator=(const SobelContext&);
+};
+
+#endif
@@ -12,10 +12,14 @@
 #include <locale.h>
 #include <err.h>
 
+#include "sobel.h"
+
+// Geometry of the demo's input; sobel.h takes any size
 #define IMG_WIDTH 640
 #define IMG_HEIGHT 480
-#define STEP0 1920
-#define STEP1 3
+
+// Fallbacks for the perf report when the frequency and energy cannot be
+// measured on this machine (see energy.h)
 #define PROC_FREQ 866000000
 #define PROC_EPC 1.4
 // #define NCORES 1
@@ -24,31 +28,29 @@
 using namespace cv;
 using namespace std;
 
-//This mutex will be used to allow threads to contest for thread 0 status
-extern pthread_barrier_t endSobel;
-extern pthread_barrier_t grayscale_barrier;
-extern pthread_barrier_t sobel_barrier;
-extern pthread_mutex_t thread0;
-extern pthread_t thread0_id;
-
-
 // Commandline options
 struct opts {
   char *videoFile;
   int webcam;
   int numFrames;
   int multiThreaded;
+  int threads;
+  int batch;
+  int pyrLevels;
+  int wideOutput;
+  int edgeStats;
+  int edgeThreshold;
+  char *metricsAddr;
+  int pages;
+  int autotune;
+  int loop;
+  int noDisplay;
 };
 
 extern struct opts opts;
 
-// void sobelCalc(Mat& img_gray, Mat& img_sobel_out);
-// void grayScale(Mat& img, Mat& img_gray_out);
-
-void sobelCalc(Mat& img_gray, Mat& img_sobel_out, int start, int end);
-void grayScale(Mat& img, Mat& img_gray_out, int start, int end);
-
+// Demo driver: runs opts on a SobelContext. Without -j the worker count
+// comes from the host's autotune cache, else NCORES with -m, else 1.
+void runSobel();
 
-void runSobelST();
-void *runSobelMT(void *ptr);
 #endif
@@ -0,0 +1,148 @@
+#include <stdio.h>
+#include <string.h>
+#include <err.h>
+#include <sys/mman.h>
+#include "sobel.h"
+
+using namespace cv;
+
+#define HUGE_PAGE_SIZE (2UL << 20)
+
+static size_t roundUp(size_t n, size_t align)
+{
+  return (n + align - 1) / align * align;
+}
+
+/*******************************************
+ * Model: sobelFrameStride
+ * Input: Row width in pixels, Mat type
+ * Output: Bytes from one row to the next
+ * Desc: Rows start on a SOBEL_ALIGN boundary. A stride that is a multiple
+ *  of 4K would map the same column of every row to the same cache sets,
+ *  so those get one extra line of padding.
+ ********************************************/
+size_t sobelFrameStride(int cols, int type)
+{
+  size_t stride = roundUp((size_t)cols * CV_ELEM_SIZE(type), SOBEL_ALIGN);
+  if (stride % 4096 == 0) {
+    stride += SOBEL_ALIGN;
+  }
+  return stride;
+}
+
+// Arena space taken by one buffer. No kernel reads past the end of a row,
+// so the rows are all there is.
+size_t sobelFrameBytes(int rows, int cols, int type)
+{
+  return sobelFrameStride(cols, type) * rows;
+}
+
+/*******************************************
+ * Model: sobelArenaInit
+ * Input: Size in bytes, SOBEL_PAGES_* mode
+ * Output: 0, or -1 with errno set if no memory could be mapped.
+ *  Initializes arena
+ * Desc: Maps the arena with the requested page size. Explicit huge pages
+ *  need vm.nr_hugepages to be set up; without them this falls back to
+ *  transparent huge pages, which the kernel may or may not provide.
+ *  arena->pages records what was actually set up. Every page is touched
+ *  up front so no frame pays for the faults.
+ ********************************************/
+int sobelArenaInit(struct sobel_arena *arena, size_t bytes, int pages)
+{
+  memset(arena, 0, sizeof(*arena));
+  void *map = MAP_FAILED;
+
+#ifdef MAP_HUGETLB
+  if (pages == SOBEL_PAGES_HUGETLB) {
+    arena->len = roundUp(bytes, HUGE_PAGE_SIZE);
+    map = mmap(NULL, arena->len, PROT_READ | PROT_WRITE,
+               MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (map == MAP_FAILED) {
+      warnx("no explicit huge pages available (see vm.nr_hugepages), "
+            "using transparent huge pages");
+      pages = SOBEL_PAGES_THP;
+    }
+  }
+#else
+  if (pages == SOBEL_PAGES_HUGETLB) {
+    pages = SOBEL_PAGES_THP;
+  }
+#endif
+
+  if (pages == SOBEL_PAGES_THP) {
+    // Over-map so the arena can start on a huge page boundary
+    arena->len = roundUp(bytes, HUGE_PAGE_SIZE);
+    unsigned char *raw = (unsigned char *)mmap(NULL, arena->len + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE,
+                                               MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (raw == MAP_FAILED) {
+      arena->len = 0;
+      return -1;
+    }
+    unsigned char *start = (unsigned char *)roundUp((size_t)raw, HUGE_PAGE_SIZE);
+    if (start > raw) {
+      munmap(raw, start - raw);
+    }
+    munmap(start + arena->len, raw + HUGE_PAGE_SIZE - start);
+    map = start;
+#ifdef MADV_HUGEPAGE
+    if (madvise(map, arena->len, MADV_HUGEPAGE) < 0) {
+      warnx("transparent huge pages not available, using 4K pages");
+      pages = SOBEL_PAGES_DEFAULT;
+    }
+#else
+    pages = SOBEL_PAGES_DEFAULT;
+#endif
+  } else if (map == MAP_FAILED) {
+    arena->len = roundUp(bytes, 4096);
+    map = mmap(NULL, arena->len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (map == MAP_FAILED) {
+      arena->len = 0;
+      return -1;
+    }
+  }
+
+  arena->base = (unsigned char *)map;
+  arena->pages = pages;
+  memset(arena->base, 0, arena->len);
+  return 0;
+}
+
+/*******************************************
+ * Model: sobelArenaMat
+ * Input: Size and type of the buffer
+ * Output: A Mat header for the next free part of the arena, or an empty
+ *  Mat if the arena is used up
+ * Desc: The Mat does not own its memory; it is valid until the arena is
+ *  freed. Its data and every row are SOBEL_ALIGN aligned.
+ ********************************************/
+Mat sobelArenaMat(struct sobel_arena *arena, int rows, int cols, int type)
+{
+  size_t bytes = sobelFrameBytes(rows, cols, type);
+  if (arena->used + bytes > arena->len) {
+    return Mat();
+  }
+  Mat m(rows, cols, type, arena->base + arena->used, sobelFrameStride(cols, type));
+  arena->used += bytes;
+  return m;
+}
+
+void sobelArenaFree(struct sobel_arena *arena)
+{
+  if (arena->base) {
+    munmap(arena->base, arena->len);
+  }
+  memset(arena, 0, sizeof(*arena));
+}
+
+const char *sobelPagesName(int pages)
+{
+  switch (pages) {
+    case SOBEL_PAGES_THP:
+      return "transparent huge pages";
+    case SOBEL_PAGES_HUGETLB:
+      return "explicit huge pages";
+    default:
+      return "default pages";
+  }
+}
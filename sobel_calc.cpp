@@ -1,16 +1,11 @@
 #include "opencv2/imgproc/imgproc.hpp"
-#include "sobel_alg.h"
+#include <string.h>
+#include "sobel.h"
 using namespace cv;
+using namespace std;
 
-/*******************************************
- * Model: grayScale
- * Input: Mat img
- * Output: None directly. Modifies a ref parameter img_gray_out
- * Desc: This module converts the image to grayscale
- ********************************************/
+#include "sobel_neon.h"
 
- #include <arm_neon.h>
- 
 // void grayScale(Mat& img, Mat& img_gray_out)
 // {
 //   // double color;
@@ -29,127 +24,468 @@ using namespace cv;
 //   }
 // }
 
-void grayScale(Mat& img, Mat& img_gray_out, int start_row, int end_row)
+// Channel layout of each sobel_order, as indices into a vld3/vld4 result
+template <int ORDER> struct pixel_layout;
+template <> struct pixel_layout<SOBEL_BGR>  { enum { channels = 3, b = 0, g = 1, r = 2 }; };
+template <> struct pixel_layout<SOBEL_RGB>  { enum { channels = 3, b = 2, g = 1, r = 0 }; };
+template <> struct pixel_layout<SOBEL_BGRA> { enum { channels = 4, b = 0, g = 1, r = 2 }; };
+
+/*******************************************
+ * Model: grayScaleRows
+ * Input: Mat img in channel order ORDER, WIDTH pixels wide (0: any width)
+ * Output: None directly. Modifies a ref parameter img_gray_out
+ * Desc: Kernel for one channel order. With a fixed WIDTH the trip count is
+ *  a constant the compiler unrolls, and since the fixed widths are
+ *  multiples of 8 the scalar tail is compiled out.
+ ********************************************/
+template <int ORDER, int WIDTH>
+static void grayScaleRows(Mat& img, Mat& img_gray_out, int start_row, int end_row)
 {
+  typedef pixel_layout<ORDER> px;
+  const int cols = WIDTH ? WIDTH : img.cols;
+
   // process rows from start_row to end_row
   for (int i = start_row; i < end_row; i++) {
-    int row_offset = i * img.cols;
-    int rgb_offset = i * STEP0;
+    const unsigned char* in_row = img.data + img.step * i;
+    unsigned char* out_row = img_gray_out.data + img_gray_out.step * i;
     int j;
-    
+
     // Neon vectorized 8 pixels at a time
-    for (j = 0; j < img.cols - 7; j += 8) {
-      // load 8 RGB triplets (24b)
-      uint8x8x3_t rgb = vld3_u8(&img.data[rgb_offset + j * 3]);
-      
-      uint16x8_t b16 = vmovl_u8(rgb.val[0]);
-      uint16x8_t g16 = vmovl_u8(rgb.val[1]);
-      uint16x8_t r16 = vmovl_u8(rgb.val[2]);
-      
-      uint16x8_t gray16 = vmulq_n_u16(b16, 29);
-      gray16 = vmlaq_n_u16(gray16, g16, 150);  // mac
-      gray16 = vmlaq_n_u16(gray16, r16, 77);
-      uint8x8_t gray8 = vshrn_n_u16(gray16, 8);
-      
-      vst1_u8(&img_gray_out.data[row_offset + j], gray8);
+    for (j = 0; j < cols - 7; j += 8) {
+      uint8x8_t b, g, r;
+      if (px::channels == 4) {
+        // load 8 quads, alpha is ignored
+        uint8x8x4_t pix = vld4_u8(in_row + j * 4);
+        b = pix.val[px::b];
+        g = pix.val[px::g];
+        r = pix.val[px::r];
+      } else {
+        // load 8 RGB triplets (24b)
+        uint8x8x3_t pix = vld3_u8(in_row + j * 3);
+        b = pix.val[px::b];
+        g = pix.val[px::g];
+        r = pix.val[px::r];
+      }
+
+      uint16x8_t gray16 = vmulq_n_u16(vmovl_u8(b), 29);
+      gray16 = vmlaq_n_u16(gray16, vmovl_u8(g), 150);  // mac
+      gray16 = vmlaq_n_u16(gray16, vmovl_u8(r), 77);
+      vst1_u8(out_row + j, vshrn_n_u16(gray16, 8));
     }
-    
-    // remaining pixels in this row (scalar)
-    for (; j < img.cols; j++) {
-      int color = (29 * img.data[rgb_offset + j*3] + 
-                   150 * img.data[rgb_offset + j*3 + 1] + 
-                   77 * img.data[rgb_offset + j*3 + 2]) >> 8;
-      img_gray_out.data[row_offset + j] = color;
+
+    // remaining pixels in this row (scalar), only for odd widths
+    if (WIDTH == 0 || WIDTH % 8) {
+      for (; j < cols; j++) {
+        const unsigned char* p = in_row + j * px::channels;
+        out_row[j] = (29 * p[px::b] + 150 * p[px::g] + 77 * p[px::r]) >> 8;
+      }
     }
   }
 }
 
+// Picks the grayScaleRows instantiation for the width of img
+template <int ORDER>
+static void grayScaleOrder(Mat& img, Mat& img_gray_out, int start_row, int end_row, int kernels)
+{
+  switch (kernels == SOBEL_KERNELS_GENERIC ? 0 : img.cols) {
+    case 1920: grayScaleRows<ORDER, 1920>(img, img_gray_out, start_row, end_row); break;
+    case 1280: grayScaleRows<ORDER, 1280>(img, img_gray_out, start_row, end_row); break;
+    case 640:  grayScaleRows<ORDER, 640>(img, img_gray_out, start_row, end_row); break;
+    default:   grayScaleRows<ORDER, 0>(img, img_gray_out, start_row, end_row); break;
+  }
+}
+
 /*******************************************
- * Model: sobelCalc
+ * Model: grayScale
+ * Input: Mat img, channel order of 3 channel images (SOBEL_BGR/SOBEL_RGB),
+ *  SOBEL_KERNELS_* choice
+ * Output: None directly. Modifies a ref parameter img_gray_out
+ * Desc: Converts rows start_row..end_row to grayscale. 1 and 4 channel
+ *  images are taken as gray and BGRA, so capture buffers with an alpha
+ *  channel need no repacking.
+ ********************************************/
+void grayScale(Mat& img, Mat& img_gray_out, int start_row, int end_row, int order, int kernels)
+{
+  switch (img.channels()) {
+    case 1:
+      // Already gray; only copy if it is not the output buffer itself
+      if (img.data != img_gray_out.data) {
+        for (int i = start_row; i < end_row; i++) {
+          memcpy(img_gray_out.data + img_gray_out.step * i, img.data + img.step * i, img.cols);
+        }
+      }
+      break;
+    case 4:
+      grayScaleOrder<SOBEL_BGRA>(img, img_gray_out, start_row, end_row, kernels);
+      break;
+    default:
+      if (order == SOBEL_RGB) {
+        grayScaleOrder<SOBEL_RGB>(img, img_gray_out, start_row, end_row, kernels);
+      } else {
+        grayScaleOrder<SOBEL_BGR>(img, img_gray_out, start_row, end_row, kernels);
+      }
+      break;
+  }
+}
+
+/*******************************************
+ * Model: pyrDown2x
  * Input: Mat img_in
- * Output: None directly. Modifies a ref parameter img_sobel_out
- * Desc: This module performs a sobel calculation on an image. It first
- *  converts the image to grayscale, calculates the gradient in the x
- *  direction, calculates the gradient in the y direction and sum it with Gx
- *  to finish the Sobel calculation
+ * Output: None directly. Modifies a ref parameter img_out
+ * Desc: Writes rows start_row..end_row of img_out as the 2x-decimated
+ *  version of img_in, each output pixel being the rounded mean of a 2x2
+ *  block of input pixels
+ ********************************************/
+void pyrDown2x(Mat& img_in, Mat& img_out, int start_row, int end_row)
+{
+  for (int i = start_row; i < end_row; i++) {
+    unsigned char* top_row = img_in.data + img_in.step * (2 * i);
+    unsigned char* bot_row = top_row + img_in.step;
+    unsigned char* out_row = img_out.data + img_out.step * i;
+    int j;
+
+    // 16 input pixels -> 8 output pixels at a time
+    for (j = 0; j < img_out.cols - 7; j += 8) {
+      uint8x16_t top = vld1q_u8(top_row + 2 * j);
+      uint8x16_t bot = vld1q_u8(bot_row + 2 * j);
+
+      // pairwise horizontal sums of both rows, then (sum + 2) >> 2
+      uint16x8_t sum = vpaddlq_u8(top);
+      sum = vpadalq_u8(sum, bot);
+      vst1_u8(out_row + j, vrshrn_n_u16(sum, 2));
+    }
+
+    // remaining pixels in this row (scalar)
+    for (; j < img_out.cols; j++) {
+      out_row[j] = (top_row[2*j] + top_row[2*j + 1] +
+                    bot_row[2*j] + bot_row[2*j + 1] + 2) >> 2;
+    }
+  }
+}
+
+/*******************************************
+ * Model: grayScalePyramid
+ * Input: Mat img, number of levels, channel order and kernels (see
+ *  grayScale)
+ * Output: None directly. Modifies img_gray_out[0..nlevels-1]
+ * Desc: Converts rows start_row..end_row of img to grayscale and builds
+ *  the decimated levels in the same pass. Rows are handled in blocks of
+ *  2^(nlevels-1) so each block is decimated while it is still in cache.
+ *  Blocks are rounded outwards, so neighbouring bands may both write the
+ *  rows they share (with identical values).
  ********************************************/
+void grayScalePyramid(Mat& img, Mat img_gray_out[], int nlevels, int start_row, int end_row,
+                      int order, int kernels)
+{
+  const int block = 1 << (nlevels - 1);
+  const int first = (start_row / block) * block;
+  const int last = min(img.rows, ((end_row + block - 1) / block) * block);
 
-void sobelCalc(Mat& img_gray, Mat& img_sobel_out, int start_row, int end_row)
+  for (int b = first; b < last; b += block) {
+    int b_end = min(b + block, last);
+    grayScale(img, img_gray_out[0], b, b_end, order, kernels);
+    for (int l = 1; l < nlevels; l++) {
+      pyrDown2x(img_gray_out[l - 1], img_gray_out[l], b >> l, b_end >> l);
+    }
+  }
+}
+
+// Fold the vector accumulators of one tile row segment into the tile
+static inline void flushTileStats(struct sobel_tile_stats* tile, uint32x4_t sum, uint16x8_t count)
 {
-  // base pointers
-  unsigned char* img_data = img_gray.data;
-  unsigned char* out_data = img_sobel_out.data;
+  uint64x2_t sum64 = vpaddlq_u32(sum);
+  uint64x2_t count64 = vpaddlq_u32(vpaddlq_u16(count));
+  tile->sum += vgetq_lane_u64(sum64, 0) + vgetq_lane_u64(sum64, 1);
+  tile->count += vgetq_lane_u64(count64, 0) + vgetq_lane_u64(count64, 1);
+}
+
+// |Gx| + |Gy| of 8 pixels, from 16 pixels of each row starting one pixel
+// to their left
+static inline int16x8_t sobelWindow(uint8x16_t prev, uint8x16_t curr, uint8x16_t next)
+{
+  // Extract 8-byte windows for sobel filter
+  uint8x8_t prev_l = vget_low_u8(prev);
+  uint8x8_t prev_m = vext_u8(vget_low_u8(prev), vget_high_u8(prev), 1);
+  uint8x8_t prev_r = vext_u8(vget_low_u8(prev), vget_high_u8(prev), 2);
+
+  uint8x8_t curr_l = vget_low_u8(curr);
+  uint8x8_t curr_r = vext_u8(vget_low_u8(curr), vget_high_u8(curr), 2);
+
+  uint8x8_t next_l = vget_low_u8(next);
+  uint8x8_t next_m = vext_u8(vget_low_u8(next), vget_high_u8(next), 1);
+  uint8x8_t next_r = vext_u8(vget_low_u8(next), vget_high_u8(next), 2);
+
+  // sign-16-bit arithmetic
+  int16x8_t prev_l16 = vreinterpretq_s16_u16(vmovl_u8(prev_l));
+  int16x8_t prev_m16 = vreinterpretq_s16_u16(vmovl_u8(prev_m));
+  int16x8_t prev_r16 = vreinterpretq_s16_u16(vmovl_u8(prev_r));
+  int16x8_t curr_l16 = vreinterpretq_s16_u16(vmovl_u8(curr_l));
+  int16x8_t curr_r16 = vreinterpretq_s16_u16(vmovl_u8(curr_r));
+  int16x8_t next_l16 = vreinterpretq_s16_u16(vmovl_u8(next_l));
+  int16x8_t next_m16 = vreinterpretq_s16_u16(vmovl_u8(next_m));
+  int16x8_t next_r16 = vreinterpretq_s16_u16(vmovl_u8(next_r));
+
+  // G_x = (prev_{r}-prev_{l}) + 2(curr_{r}-curr_{l}) + (next_{r}-next_{l})
+  int16x8_t gx = vsubq_s16(prev_r16, prev_l16);
+  gx = vaddq_s16(gx, vshlq_n_s16(vsubq_s16(curr_r16, curr_l16), 1));
+  gx = vaddq_s16(gx, vsubq_s16(next_r16, next_l16));
+  gx = vabsq_s16(gx);
+
+  // G_y = (next_l-prev_l) + 2(next_m-prev_m) + (next_r-prev_r)
+  int16x8_t gy = vsubq_s16(next_l16, prev_l16);
+  gy = vaddq_s16(gy, vshlq_n_s16(vsubq_s16(next_m16, prev_m16), 1));
+  gy = vaddq_s16(gy, vsubq_s16(next_r16, prev_r16));
+  gy = vabsq_s16(gy);
+
+  // comb
+  return vaddq_s16(gx, gy);
+}
+
+// |Gx| + |Gy| of the 8 pixels at curr_row[j..j+7]. Loads curr_row[j-1..j+14]
+static inline int16x8_t sobelVec(const unsigned char* prev_row, const unsigned char* curr_row,
+                                 const unsigned char* next_row, int j)
+{
+  return sobelWindow(vld1q_u8(prev_row + j - 1), vld1q_u8(curr_row + j - 1),
+                     vld1q_u8(next_row + j - 1));
+}
+
+// |Gx| + |Gy| of the 8 pixels ending at cols - 2. Loads the last 16 pixels
+// of each row and moves pixel cols - 10 to lane 0, so nothing past the row
+// is read: frames may be views that end where their mapping does.
+static inline int16x8_t sobelVecLast(const unsigned char* prev_row, const unsigned char* curr_row,
+                                     const unsigned char* next_row, int cols)
+{
+  uint8x16_t prev = vld1q_u8(prev_row + cols - 16);
+  uint8x16_t curr = vld1q_u8(curr_row + cols - 16);
+  uint8x16_t next = vld1q_u8(next_row + cols - 16);
+  return sobelWindow(vextq_u8(prev, prev, 6), vextq_u8(curr, curr, 6), vextq_u8(next, next, 6));
+}
+
+// Add lanes first_lane..7 of mag16 to the running tile sums and histogram
+static inline void accumulateStats(unsigned int* hist, uint16x8_t mag16, uint16x8_t thresh,
+                                   uint32x4_t& tile_sum, uint16x8_t& tile_count, int first_lane)
+{
+  // compare yields all ones (-1) for lanes above the threshold
+  uint16x8_t above = vcgtq_u16(mag16, thresh);
+  if (first_lane) {
+    static const uint16_t lanes[8] = {0, 1, 2, 3, 4, 5, 6, 7};
+    uint16x8_t keep = vcgeq_u16(vld1q_u16(lanes), vdupq_n_u16(first_lane));
+    mag16 = vandq_u16(mag16, keep);
+    above = vandq_u16(above, keep);
+  }
+  tile_sum = vpadalq_u16(tile_sum, mag16);
+  tile_count = vsubq_u16(tile_count, above);
+
+  uint16_t bins[8];
+  vst1q_u16(bins, vshrq_n_u16(mag16, SOBEL_HIST_SHIFT));
+  if (first_lane) {
+    for (int k = first_lane; k < 8; k++) {
+      hist[bins[k]]++;
+    }
+  } else {
+    hist[bins[0]]++; hist[bins[1]]++; hist[bins[2]]++; hist[bins[3]]++;
+    hist[bins[4]]++; hist[bins[5]]++; hist[bins[6]]++; hist[bins[7]]++;
+  }
+}
+
+/*******************************************
+ * Model: sobelRows
+ * Input: Mat img_gray, WIDTH pixels wide (0: any width)
+ * Output: None directly. Modifies img_sobel_out, and img_sobel16_out and
+ *  stats if WIDE and STATS are set
+ * Desc: Kernel for one output configuration. With a fixed WIDTH the last
+ *  few pixels of a row are done by one more vector, overlapping the
+ *  previous one, instead of a scalar tail; overlapped lanes are rewritten
+ *  with the same values and masked out of the statistics. No load reads
+ *  past the last pixel of a row (see sobelVecLast). The fixed
+ *  widths are multiples of SOBEL_TILE_W, so that vector never straddles
+ *  two tiles either.
+ ********************************************/
+template <int WIDTH, bool WIDE, bool STATS>
+static void sobelRows(Mat& img_gray, Mat& img_sobel_out, int start_row, int end_row,
+                      Mat* img_sobel16_out, struct sobel_stats* stats)
+{
+  const int cols = WIDTH ? WIDTH : img_gray.cols;
+  const uint16x8_t thresh = vdupq_n_u16(STATS ? stats->threshold : 0);
 
   // Process rows
   for (int i = start_row + 1; i < end_row - 1; i++) {
-    unsigned char* prev_row = img_data + IMG_WIDTH * (i - 1);
-    unsigned char* curr_row = img_data + IMG_WIDTH * i;
-    unsigned char* next_row = img_data + IMG_WIDTH * (i + 1);
-    unsigned char* out_row = out_data + IMG_WIDTH * i;
-    
+    unsigned char* prev_row = img_gray.data + img_gray.step * (i - 1);
+    unsigned char* curr_row = img_gray.data + img_gray.step * i;
+    unsigned char* next_row = img_gray.data + img_gray.step * (i + 1);
+    unsigned char* out_row = img_sobel_out.data + img_sobel_out.step * i;
+    uint16_t* out16_row = WIDE ?
+      (uint16_t*)(img_sobel16_out->data + img_sobel16_out->step * i) : NULL;
+
+    // Running sum and threshold count of the current tile, kept in registers
+    struct sobel_tile_stats* tile_row = STATS ? stats->tiles[i / SOBEL_TILE_H] : NULL;
+    uint32x4_t tile_sum = vdupq_n_u32(0);
+    uint16x8_t tile_count = vdupq_n_u16(0);
+    int tx = 0;
+
     int j;
-    
-    // 8 pixels at a time
-    for (j = 1; j < img_gray.cols - 8; j += 8) {
-      // Load 16 pixels from each row
-      uint8x16_t prev = vld1q_u8(prev_row + j - 1);
-      uint8x16_t curr = vld1q_u8(curr_row + j - 1);
-      uint8x16_t next = vld1q_u8(next_row + j - 1);
-      
-      // Extract 8-byte windows for sobel filter
-      uint8x8_t prev_l = vget_low_u8(prev);
-      uint8x8_t prev_m = vext_u8(vget_low_u8(prev), vget_high_u8(prev), 1);
-      uint8x8_t prev_r = vext_u8(vget_low_u8(prev), vget_high_u8(prev), 2);
-      
-      uint8x8_t curr_l = vget_low_u8(curr);
-      uint8x8_t curr_r = vext_u8(vget_low_u8(curr), vget_high_u8(curr), 2);
-      
-      uint8x8_t next_l = vget_low_u8(next);
-      uint8x8_t next_m = vext_u8(vget_low_u8(next), vget_high_u8(next), 1);
-      uint8x8_t next_r = vext_u8(vget_low_u8(next), vget_high_u8(next), 2);
-      
-      // sign-16-bit arithmetic
-      int16x8_t prev_l16 = vreinterpretq_s16_u16(vmovl_u8(prev_l));
-      int16x8_t prev_m16 = vreinterpretq_s16_u16(vmovl_u8(prev_m));
-      int16x8_t prev_r16 = vreinterpretq_s16_u16(vmovl_u8(prev_r));
-      int16x8_t curr_l16 = vreinterpretq_s16_u16(vmovl_u8(curr_l));
-      int16x8_t curr_r16 = vreinterpretq_s16_u16(vmovl_u8(curr_r));
-      int16x8_t next_l16 = vreinterpretq_s16_u16(vmovl_u8(next_l));
-      int16x8_t next_m16 = vreinterpretq_s16_u16(vmovl_u8(next_m));
-      int16x8_t next_r16 = vreinterpretq_s16_u16(vmovl_u8(next_r));
-      
-      // G_x = (prev_{r}-prev_{l}) + 2(curr_{r}-curr_{l}) + (next_{r}-next_{l})
-      int16x8_t gx = vsubq_s16(prev_r16, prev_l16);
-      gx = vaddq_s16(gx, vshlq_n_s16(vsubq_s16(curr_r16, curr_l16), 1));
-      gx = vaddq_s16(gx, vsubq_s16(next_r16, next_l16));
-      gx = vabsq_s16(gx);
-      
-      // G_y = (next_l-prev_l) + 2(next_m-prev_m) + (next_r-prev_r)
-      int16x8_t gy = vsubq_s16(next_l16, prev_l16);
-      gy = vaddq_s16(gy, vshlq_n_s16(vsubq_s16(next_m16, prev_m16), 1));
-      gy = vaddq_s16(gy, vsubq_s16(next_r16, prev_r16));
-      gy = vabsq_s16(gy);
-      
-      // comb
-      int16x8_t mag = vaddq_s16(gx, gy);
-      uint8x8_t result = vqmovun_s16(mag);
-      
+
+    // 8 pixels at a time, while the loads stay inside the row
+    for (j = 1; j < cols - 14; j += 8) {
+      int16x8_t mag = sobelVec(prev_row, curr_row, next_row, j);
+      uint16x8_t mag16 = vreinterpretq_u16_s16(mag);
+
       // Store
-      vst1_u8(out_row + j, result);
+      vst1_u8(out_row + j, vqmovun_s16(mag));
+      if (WIDE) {
+        vst1q_u16(out16_row + j, mag16);
+      }
+
+      if (STATS) {
+        if ((j - 1) / SOBEL_TILE_W != tx) {
+          flushTileStats(&tile_row[tx], tile_sum, tile_count);
+          tile_sum = vdupq_n_u32(0);
+          tile_count = vdupq_n_u16(0);
+          tx = (j - 1) / SOBEL_TILE_W;
+        }
+        accumulateStats(tile_row[tx].hist, mag16, thresh, tile_sum, tile_count, 0);
+      }
+    }
+
+    // Last pixels of the row as one vector ending at cols - 2
+    if (WIDTH && j < cols - 1) {
+      const int first_lane = 8 - (cols - 1 - j);
+      j = cols - 9;
+      int16x8_t mag = sobelVecLast(prev_row, curr_row, next_row, cols);
+      uint16x8_t mag16 = vreinterpretq_u16_s16(mag);
+
+      vst1_u8(out_row + j, vqmovun_s16(mag));
+      if (WIDE) {
+        vst1q_u16(out16_row + j, mag16);
+      }
+      if (STATS) {
+        accumulateStats(tile_row[tx].hist, mag16, thresh, tile_sum, tile_count, first_lane);
+      }
+      j = cols - 1;
+    }
+
+    if (STATS) {
+      flushTileStats(&tile_row[tx], tile_sum, tile_count);
     }
-    
-    // Scalar for remaining pixels
-    for (; j < img_gray.cols - 1; j++) {
+
+    // Scalar for remaining pixels, only for widths without a kernel
+    for (; j < cols - 1; j++) {
       int gx = abs((int)prev_row[j+1] - (int)prev_row[j-1] +
                    2*((int)curr_row[j+1] - (int)curr_row[j-1]) +
                    (int)next_row[j+1] - (int)next_row[j-1]);
-      
+
       int gy = abs((int)next_row[j-1] - (int)prev_row[j-1] +
                    2*((int)next_row[j] - (int)prev_row[j]) +
                    (int)next_row[j+1] - (int)prev_row[j+1]);
-      
+
       int mag = gx + gy;
       out_row[j] = (mag > 255) ? 255 : mag;
+
+      if (WIDE) {
+        out16_row[j] = mag;
+      }
+      if (STATS) {
+        struct sobel_tile_stats* tile = &tile_row[(j - 1) / SOBEL_TILE_W];
+        tile->hist[mag >> SOBEL_HIST_SHIFT]++;
+        tile->sum += mag;
+        tile->count += (mag > stats->threshold);
+      }
+    }
+  }
+}
+
+// Picks the sobelRows instantiation for the requested outputs
+template <int WIDTH>
+static void sobelOutputs(Mat& img_gray, Mat& img_sobel_out, int start_row, int end_row,
+                         Mat* img_sobel16_out, struct sobel_stats* stats)
+{
+  if (img_sobel16_out && stats) {
+    sobelRows<WIDTH, true, true>(img_gray, img_sobel_out, start_row, end_row, img_sobel16_out, stats);
+  } else if (img_sobel16_out) {
+    sobelRows<WIDTH, true, false>(img_gray, img_sobel_out, start_row, end_row, img_sobel16_out, stats);
+  } else if (stats) {
+    sobelRows<WIDTH, false, true>(img_gray, img_sobel_out, start_row, end_row, img_sobel16_out, stats);
+  } else {
+    sobelRows<WIDTH, false, false>(img_gray, img_sobel_out, start_row, end_row, img_sobel16_out, stats);
+  }
+}
+
+/*******************************************
+ * Model: sobelCalc
+ * Input: Mat img_in
+ * Output: None directly. Modifies a ref parameter img_sobel_out
+ * Desc: This module performs a sobel calculation on an image. It
+ *  calculates the gradient in the x direction, calculates the gradient in
+ *  the y direction and sum it with Gx to finish the Sobel calculation.
+ *  If img_sobel16_out is given, the unsaturated 16-bit magnitude is written
+ *  there as well. If stats is given, the tile histograms, sums and
+ *  threshold counts of the processed rows are accumulated from the vector
+ *  registers as they are produced (see sobelStatsReduce for frame totals).
+ *  Full resolution widths of 640, 1280 and 1920 and their pyramid levels
+ *  have their own kernels; any other width, or SOBEL_KERNELS_GENERIC,
+ *  uses the generic one.
+ ********************************************/
+void sobelCalc(Mat& img_gray, Mat& img_sobel_out, int start_row, int end_row,
+               Mat* img_sobel16_out, struct sobel_stats* stats, int kernels)
+{
+  switch (kernels == SOBEL_KERNELS_GENERIC ? 0 : img_gray.cols) {
+    case 1920: sobelOutputs<1920>(img_gray, img_sobel_out, start_row, end_row, img_sobel16_out, stats); break;
+    case 1280: sobelOutputs<1280>(img_gray, img_sobel_out, start_row, end_row, img_sobel16_out, stats); break;
+    case 960:  sobelOutputs<960>(img_gray, img_sobel_out, start_row, end_row, img_sobel16_out, stats); break;
+    case 640:  sobelOutputs<640>(img_gray, img_sobel_out, start_row, end_row, img_sobel16_out, stats); break;
+    case 480:  sobelOutputs<480>(img_gray, img_sobel_out, start_row, end_row, img_sobel16_out, stats); break;
+    case 320:  sobelOutputs<320>(img_gray, img_sobel_out, start_row, end_row, img_sobel16_out, stats); break;
+    case 160:  sobelOutputs<160>(img_gray, img_sobel_out, start_row, end_row, img_sobel16_out, stats); break;
+    default:   sobelOutputs<0>(img_gray, img_sobel_out, start_row, end_row, img_sobel16_out, stats); break;
+  }
+}
+
+/*******************************************
+ * Model: sobelStatsReset
+ * Input: Threshold for the edge count, frame size
+ * Output: 0, or -1 if the frame is larger than the tile grid or the
+ *  threshold is outside 0..SOBEL_MAX_MAGNITUDE. Modifies stats
+ * Desc: Clears the statistics before the Sobel pass of a new frame. Only
+ *  the tiles covering a rows x cols frame are cleared and later reduced.
+ ********************************************/
+int sobelStatsReset(struct sobel_stats* stats, int threshold, int rows, int cols)
+{
+  if (rows > SOBEL_MAX_HEIGHT || cols > SOBEL_MAX_WIDTH) {
+    return -1;
+  }
+  // The vector loop compares 16-bit lanes, the scalar tail ints; they
+  // only agree on thresholds a magnitude can take
+  if (threshold < 0 || threshold > SOBEL_MAX_MAGNITUDE) {
+    return -1;
+  }
+  stats->threshold = threshold;
+  stats->tiles_x = (cols + SOBEL_TILE_W - 1) / SOBEL_TILE_W;
+  stats->tiles_y = (rows + SOBEL_TILE_H - 1) / SOBEL_TILE_H;
+  memset(&stats->frame, 0, sizeof(stats->frame));
+  memset(stats->tiles, 0, stats->tiles_y * sizeof(stats->tiles[0]));
+  return 0;
+}
+
+/*******************************************
+ * Model: sobelStatsReduce
+ * Input: None
+ * Output: None directly. Modifies stats->frame
+ * Desc: Sums the tile statistics into the frame statistics once every
+ *  band of the frame has been through sobelCalc
+ ********************************************/
+void sobelStatsReduce(struct sobel_stats* stats)
+{
+  struct sobel_tile_stats* frame = &stats->frame;
+  memset(frame, 0, sizeof(*frame));
+
+  for (int ty = 0; ty < stats->tiles_y; ty++) {
+    for (int tx = 0; tx < stats->tiles_x; tx++) {
+      struct sobel_tile_stats* tile = &stats->tiles[ty][tx];
+      for (int b = 0; b < SOBEL_HIST_BINS; b++) {
+        frame->hist[b] += tile->hist[b];
+      }
+      frame->sum += tile->sum;
+      frame->count += tile->count;
     }
   }
 }
\ No newline at end of file
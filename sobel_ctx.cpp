@@ -0,0 +1,400 @@
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include "sobel.h"
+
+using namespace cv;
+
+// Everything but the frame size, which the caller has to set
+void sobelConfigInit(struct sobel_config *config)
+{
+  memset(config, 0, sizeof(*config));
+  config->threads = 1;
+  config->pyr_levels = 1;
+  config->order = SOBEL_BGR;
+  config->pages = SOBEL_PAGES_DEFAULT;
+  config->band_rows = 0;
+  config->fused = 0;
+  config->kernels = SOBEL_KERNELS_SPECIALIZED;
+}
+
+/*******************************************
+ * Model: SobelContext
+ * Input: Configuration
+ * Output: None
+ * Desc: Checks the configuration, allocates the buffers for one frame and
+ *  starts the workers. On failure error() says why and the context does
+ *  nothing but report it.
+ ********************************************/
+SobelContext::SobelContext(const struct sobel_config& config)
+  : cfg(config), ready(false), err(NULL), threads(NULL), args(NULL), started(0),
+    sync_init(false), generation(0), quit(false), batch_frames(NULL), batch_count(0),
+    results(NULL), results_cap(0), hook(NULL), hook_arg(NULL)
+{
+  memset(&arena, 0, sizeof(arena));
+  if (cfg.width <= 0 || cfg.height <= 0) {
+    setError("SobelContext: frame size not set");
+    return;
+  }
+  if (cfg.threads < 1) {
+    setError("SobelContext: invalid number of threads: %d", cfg.threads);
+    return;
+  }
+  if (cfg.pyr_levels < 1 || cfg.pyr_levels > PYR_MAX_LEVELS) {
+    setError("SobelContext: invalid number of pyramid levels: %d", cfg.pyr_levels);
+    return;
+  }
+  // Every level needs at least one vector of interior pixels
+  if ((cfg.width >> (cfg.pyr_levels - 1)) < 16 || (cfg.height >> (cfg.pyr_levels - 1)) < 3) {
+    setError("SobelContext: %dx%d frame too small for %d levels",
+             cfg.width, cfg.height, cfg.pyr_levels);
+    return;
+  }
+  if (cfg.edge_stats && (cfg.width > SOBEL_MAX_WIDTH || cfg.height > SOBEL_MAX_HEIGHT)) {
+    setError("SobelContext: edge statistics support frames up to %dx%d",
+             SOBEL_MAX_WIDTH, SOBEL_MAX_HEIGHT);
+    return;
+  }
+  if (cfg.edge_stats && (cfg.edge_threshold < 0 || cfg.edge_threshold > SOBEL_MAX_MAGNITUDE)) {
+    setError("SobelContext: invalid edge threshold: %d (must be 0-%d)",
+             cfg.edge_threshold, SOBEL_MAX_MAGNITUDE);
+    return;
+  }
+
+  // Bands start on a multiple of the pyramid block so every level splits
+  // on a whole row, and on a tile boundary when edge statistics are
+  // collected so each worker owns its tiles. Fused bands need at least two
+  // rows at every level.
+  if (cfg.band_rows < 0) {
+    setError("SobelContext: invalid band height: %d", cfg.band_rows);
+    return;
+  }
+  if (cfg.band_rows) {
+    int align = cfg.edge_stats ? SOBEL_TILE_H : 1 << (cfg.pyr_levels - 1);
+    int rows = std::max(cfg.band_rows, 2 << (cfg.pyr_levels - 1));
+    cfg.band_rows = (rows + align - 1) / align * align;
+  }
+
+  if (!reserve(1)) {
+    return;
+  }
+
+  pthread_mutex_init(&lock, NULL);
+  pthread_cond_init(&wake, NULL);
+  pthread_barrier_init(&stage_barrier, NULL, cfg.threads);
+  pthread_barrier_init(&done_barrier, NULL, cfg.threads);
+  sync_init = true;
+
+  // The calling thread is worker 0
+  threads = new pthread_t[cfg.threads];
+  args = new struct worker_arg[cfg.threads];
+  for (started = 1; started < cfg.threads; started++) {
+    args[started].ctx = this;
+    args[started].index = started;
+    int ret;
+    if ((ret = pthread_create(&threads[started], NULL, workerMain, &args[started]))) {
+      setError("SobelContext: thread creation failed: %s", strerror(ret));
+      return;
+    }
+  }
+  ready = true;
+}
+
+SobelContext::~SobelContext()
+{
+  if (sync_init) {
+    pthread_mutex_lock(&lock);
+    quit = true;
+    pthread_cond_broadcast(&wake);
+    pthread_mutex_unlock(&lock);
+
+    for (int w = 1; w < started; w++) {
+      pthread_join(threads[w], NULL);
+    }
+
+    pthread_barrier_destroy(&stage_barrier);
+    pthread_barrier_destroy(&done_barrier);
+    pthread_cond_destroy(&wake);
+    pthread_mutex_destroy(&lock);
+  }
+
+  delete[] threads;
+  delete[] args;
+  delete[] results;
+  sobelArenaFree(&arena);
+}
+
+// Records a failure for error(); always false, so callers can return it
+bool SobelContext::setError(const char *fmt, ...)
+{
+  va_list ap;
+  va_start(ap, fmt);
+  vsnprintf(err_buf, sizeof(err_buf), fmt, ap);
+  va_end(ap);
+  err = err_buf;
+  return false;
+}
+
+void SobelContext::set_stage_hook(sobel_stage_hook stage_hook, void *arg)
+{
+  hook = stage_hook;
+  hook_arg = arg;
+}
+
+/*******************************************
+ * Model: reserve
+ * Input: Number of frames in the next batch
+ * Output: false, with error() set, if the buffers cannot be mapped; the
+ *  old ones are kept then
+ * Desc: Makes sure there is one set of output buffers per frame of the
+ *  batch, so workers that are ahead never overwrite a frame another worker
+ *  is still reading. All of them come from one arena.
+ ********************************************/
+bool SobelContext::reserve(int count)
+{
+  if (count <= results_cap) {
+    return true;
+  }
+
+  size_t bytes = 0;
+  for (int l = 0; l < cfg.pyr_levels; l++) {
+    bytes += 2 * sobelFrameBytes(cfg.height >> l, cfg.width >> l, CV_8UC1);
+  }
+  if (cfg.wide_output) {
+    bytes += sobelFrameBytes(cfg.height, cfg.width, CV_16UC1);
+  }
+
+  // The arena comes zeroed; border rows and columns are never written by
+  // sobelCalc
+  struct sobel_arena fresh;
+  if (sobelArenaInit(&fresh, bytes * count, cfg.pages) < 0) {
+    return setError("SobelContext: cannot map %zu bytes of frame buffers: %s",
+                    bytes * count, strerror(errno));
+  }
+  sobelArenaFree(&arena);
+  arena = fresh;
+
+  delete[] results;
+  results = new struct sobel_result[count];
+  results_cap = count;
+
+  for (int k = 0; k < count; k++) {
+    struct sobel_result& r = results[k];
+    for (int l = 0; l < cfg.pyr_levels; l++) {
+      r.gray[l] = sobelArenaMat(&arena, cfg.height >> l, cfg.width >> l, CV_8UC1);
+      r.sobel[l] = sobelArenaMat(&arena, cfg.height >> l, cfg.width >> l, CV_8UC1);
+    }
+    r.gray_buf = r.gray[0];
+    if (cfg.wide_output) {
+      r.sobel16 = sobelArenaMat(&arena, cfg.height, cfg.width, CV_16UC1);
+    }
+  }
+  return true;
+}
+
+/*******************************************
+ * Model: bandRow
+ * Input: Worker index (0..threads)
+ * Output: First row of that worker's band at full resolution
+ * Desc: For one band per worker. Bands are aligned like band_rows (see
+ *  the constructor).
+ ********************************************/
+int SobelContext::bandRow(int worker) const
+{
+  int align = 1 << (cfg.pyr_levels - 1);
+  if (cfg.edge_stats) {
+    align = SOBEL_TILE_H;
+  }
+  int units = (cfg.height + align - 1) / align;
+  return std::min(cfg.height, units * worker / cfg.threads * align);
+}
+
+/*******************************************
+ * Model: band
+ * Input: Worker index, index of the band among that worker's bands
+ * Output: false once the worker has no more bands. Sets start and end
+ * Desc: Rows start..end of the frame make up the band
+ ********************************************/
+bool SobelContext::band(int worker, int index, int *start, int *end) const
+{
+  if (cfg.band_rows == 0) {
+    *start = bandRow(worker);
+    *end = bandRow(worker + 1);
+    return index == 0 && *start < *end;
+  }
+
+  *start = (worker + index * cfg.threads) * cfg.band_rows;
+  *end = std::min(*start + cfg.band_rows, cfg.height);
+  return *start < cfg.height;
+}
+
+// Sobel output rows start+1..end-2 of one level; 16-bit output and
+// statistics are only kept for the full resolution level
+void SobelContext::sobelLevel(struct sobel_result& r, int level, int start, int end)
+{
+  if (level == 0) {
+    sobelCalc(r.gray[0], r.sobel[0], start, end,
+              cfg.wide_output ? &r.sobel16 : NULL,
+              cfg.edge_stats ? &r.stats : NULL, cfg.kernels);
+  } else {
+    sobelCalc(r.gray[level], r.sobel[level], start, end, NULL, NULL, cfg.kernels);
+  }
+}
+
+/*******************************************
+ * Model: runBatch
+ * Input: Worker index
+ * Output: None directly. Fills this worker's bands of every result
+ * Desc: Grayscale then Sobel for each frame of the batch. The Sobel rows
+ *  at the edges of a band read one gray row of the neighbouring band,
+ *  which may belong to another worker, so the workers meet at
+ *  stage_barrier before doing them.
+ ********************************************/
+void SobelContext::runBatch(int worker)
+{
+  int start, end;
+
+  for (int k = 0; k < batch_count; k++) {
+    Mat& frame = batch_frames[k];
+    struct sobel_result& r = results[k];
+
+    if (hook) hook(hook_arg, worker, SOBEL_STAGE_GRAY, 1);
+    for (int b = 0; band(worker, b, &start, &end); b++) {
+      grayScalePyramid(frame, r.gray, cfg.pyr_levels, start, end, cfg.order, cfg.kernels);
+      if (cfg.fused) {
+        // Rows whose neighbours are all in this band
+        for (int l = 0; l < cfg.pyr_levels; l++) {
+          sobelLevel(r, l, start >> l, end >> l);
+        }
+      }
+    }
+    if (hook) hook(hook_arg, worker, SOBEL_STAGE_GRAY, 0);
+
+    if (cfg.threads > 1) {
+      pthread_barrier_wait(&stage_barrier);
+    }
+
+    if (hook) hook(hook_arg, worker, SOBEL_STAGE_SOBEL, 1);
+    for (int b = 0; band(worker, b, &start, &end); b++) {
+      for (int l = 0; l < cfg.pyr_levels; l++) {
+        const int rows = cfg.height >> l;
+        const int lstart = start >> l;
+        const int lend = end >> l;
+        if (lstart >= lend) {
+          continue;
+        }
+        if (!cfg.fused) {
+          sobelLevel(r, l, std::max(lstart - 1, 0), std::min(lend + 1, rows));
+          continue;
+        }
+        // First and last row of the band, unless they are frame borders
+        sobelLevel(r, l, std::max(lstart - 1, 0), std::min(lstart + 2, rows));
+        if (lend - 1 > lstart) {
+          sobelLevel(r, l, lend - 2, std::min(lend + 1, rows));
+        }
+      }
+    }
+    if (hook) hook(hook_arg, worker, SOBEL_STAGE_SOBEL, 0);
+  }
+}
+
+void *SobelContext::workerMain(void *ptr)
+{
+  struct worker_arg *arg = (struct worker_arg *)ptr;
+  SobelContext *ctx = arg->ctx;
+  unsigned int seen = 0;
+
+  while (1) {
+    pthread_mutex_lock(&ctx->lock);
+    while (ctx->generation == seen && !ctx->quit) {
+      pthread_cond_wait(&ctx->wake, &ctx->lock);
+    }
+    seen = ctx->generation;
+    bool done = ctx->quit;
+    pthread_mutex_unlock(&ctx->lock);
+    if (done) {
+      break;
+    }
+
+    ctx->runBatch(arg->index);
+    pthread_barrier_wait(&ctx->done_barrier);
+  }
+  return NULL;
+}
+
+/*******************************************
+ * Model: process_batch
+ * Input: count frames of the configured size, 3, 4 or 1 channels
+ * Output: count results, in the same order as frames, or NULL with
+ *  error() set if the context is unusable or a frame does not match
+ * Desc: Runs the whole batch on all workers and returns once every frame
+ *  is done. Results stay valid until the next call; gray[0] of a single
+ *  channel frame is the frame itself, so the frame must stay valid too.
+ ********************************************/
+struct sobel_result* SobelContext::process_batch(Mat frames[], int count)
+{
+  if (!ready) {
+    return NULL;
+  }
+  if (count < 1) {
+    setError("SobelContext: empty batch");
+    return NULL;
+  }
+  for (int k = 0; k < count; k++) {
+    Mat& frame = frames[k];
+    if (frame.rows != cfg.height || frame.cols != cfg.width ||
+        (frame.type() != CV_8UC3 && frame.type() != CV_8UC4 && frame.type() != CV_8UC1)) {
+      setError("SobelContext: expected %dx%d 3, 4 or 1 channel frames, got %dx%d type %d",
+               cfg.width, cfg.height, frame.cols, frame.rows, frame.type());
+      return NULL;
+    }
+  }
+  if (!reserve(count)) {
+    return NULL;
+  }
+  err = NULL;
+
+  for (int k = 0; k < count; k++) {
+    Mat& frame = frames[k];
+    struct sobel_result& r = results[k];
+
+    // Gray input is used in place as level 0
+    if (frame.channels() == 1) {
+      r.gray[0] = frame;
+    } else {
+      r.gray[0] = r.gray_buf;
+    }
+    if (cfg.edge_stats) {
+      sobelStatsReset(&r.stats, cfg.edge_threshold, cfg.height, cfg.width);
+    }
+  }
+
+  batch_frames = frames;
+  batch_count = count;
+  if (cfg.threads > 1) {
+    pthread_mutex_lock(&lock);
+    generation++;
+    pthread_cond_broadcast(&wake);
+    pthread_mutex_unlock(&lock);
+  }
+
+  runBatch(0);
+
+  if (cfg.threads > 1) {
+    pthread_barrier_wait(&done_barrier);
+  }
+
+  if (cfg.edge_stats) {
+    for (int k = 0; k < count; k++) {
+      sobelStatsReduce(&results[k].stats);
+    }
+  }
+  return results;
+}
+
+struct sobel_result* SobelContext::process(Mat& frame)
+{
+  return process_batch(&frame, 1);
+}
@@ -0,0 +1,197 @@
+#ifndef SOBEL_NEON_H
+#define SOBEL_NEON_H
+
+// NEON intrinsics for the kernels. On ARM these are the real ones; on
+// other machines the subset the kernels use is defined on GCC vector types
+// with the same lane semantics, so the library builds and runs anywhere
+// and the compiler maps the vectors onto the host's SIMD unit.
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#else
+
+#include <stdint.h>
+#include <string.h>
+
+typedef uint8_t uint8x8_t __attribute__((vector_size(8)));
+typedef uint8_t uint8x16_t __attribute__((vector_size(16)));
+typedef uint16_t uint16x8_t __attribute__((vector_size(16)));
+typedef int16_t int16x8_t __attribute__((vector_size(16)));
+typedef uint32_t uint32x4_t __attribute__((vector_size(16)));
+typedef uint64_t uint64x2_t __attribute__((vector_size(16)));
+
+typedef struct { uint8x8_t val[3]; } uint8x8x3_t;
+typedef struct { uint8x8_t val[4]; } uint8x8x4_t;
+
+// Loads and stores
+static inline uint8x16_t vld1q_u8(const uint8_t *p)
+{
+  uint8x16_t r;
+  memcpy(&r, p, sizeof(r));
+  return r;
+}
+
+static inline uint16x8_t vld1q_u16(const uint16_t *p)
+{
+  uint16x8_t r;
+  memcpy(&r, p, sizeof(r));
+  return r;
+}
+
+static inline uint8x8x3_t vld3_u8(const uint8_t *p)
+{
+  uint8x8x3_t r;
+  for (int i = 0; i < 8; i++) {
+    r.val[0][i] = p[3 * i];
+    r.val[1][i] = p[3 * i + 1];
+    r.val[2][i] = p[3 * i + 2];
+  }
+  return r;
+}
+
+static inline uint8x8x4_t vld4_u8(const uint8_t *p)
+{
+  uint8x8x4_t r;
+  for (int i = 0; i < 8; i++) {
+    r.val[0][i] = p[4 * i];
+    r.val[1][i] = p[4 * i + 1];
+    r.val[2][i] = p[4 * i + 2];
+    r.val[3][i] = p[4 * i + 3];
+  }
+  return r;
+}
+
+static inline void vst1_u8(uint8_t *p, uint8x8_t v) { memcpy(p, &v, sizeof(v)); }
+static inline void vst1q_u16(uint16_t *p, uint16x8_t v) { memcpy(p, &v, sizeof(v)); }
+
+// Lane moves
+static inline uint8x8_t vget_low_u8(uint8x16_t v)
+{
+  uint8x8_t r;
+  memcpy(&r, &v, sizeof(r));
+  return r;
+}
+
+static inline uint8x8_t vget_high_u8(uint8x16_t v)
+{
+  uint8x8_t r;
+  memcpy(&r, (const uint8_t *)&v + 8, sizeof(r));
+  return r;
+}
+
+// Lanes n..7 of a followed by lanes 0..n-1 of b
+static inline uint8x8_t vext_u8(uint8x8_t a, uint8x8_t b, int n)
+{
+  uint8x8_t r;
+  for (int i = 0; i < 8; i++) {
+    r[i] = (i + n < 8) ? a[i + n] : b[i + n - 8];
+  }
+  return r;
+}
+
+// Lanes n..15 of a followed by lanes 0..n-1 of b
+static inline uint8x16_t vextq_u8(uint8x16_t a, uint8x16_t b, int n)
+{
+  uint8x16_t r;
+  for (int i = 0; i < 16; i++) {
+    r[i] = (i + n < 16) ? a[i + n] : b[i + n - 16];
+  }
+  return r;
+}
+
+static inline uint64_t vgetq_lane_u64(uint64x2_t v, int lane) { return v[lane]; }
+static inline uint16x8_t vdupq_n_u16(uint16_t x) { uint16x8_t r = {x, x, x, x, x, x, x, x}; return r; }
+static inline uint32x4_t vdupq_n_u32(uint32_t x) { uint32x4_t r = {x, x, x, x}; return r; }
+static inline int16x8_t vreinterpretq_s16_u16(uint16x8_t v) { return (int16x8_t)v; }
+static inline uint16x8_t vreinterpretq_u16_s16(int16x8_t v) { return (uint16x8_t)v; }
+
+// Widening and narrowing
+static inline uint16x8_t vmovl_u8(uint8x8_t v)
+{
+  uint16x8_t r;
+  for (int i = 0; i < 8; i++) {
+    r[i] = v[i];
+  }
+  return r;
+}
+
+static inline uint8x8_t vshrn_n_u16(uint16x8_t v, int n)
+{
+  uint8x8_t r;
+  for (int i = 0; i < 8; i++) {
+    r[i] = (uint8_t)(v[i] >> n);
+  }
+  return r;
+}
+
+static inline uint8x8_t vrshrn_n_u16(uint16x8_t v, int n)
+{
+  uint8x8_t r;
+  for (int i = 0; i < 8; i++) {
+    r[i] = (uint8_t)(((uint32_t)v[i] + (1u << (n - 1))) >> n);
+  }
+  return r;
+}
+
+static inline uint8x8_t vqmovun_s16(int16x8_t v)
+{
+  uint8x8_t r;
+  for (int i = 0; i < 8; i++) {
+    r[i] = (v[i] < 0) ? 0 : (v[i] > 255) ? 255 : v[i];
+  }
+  return r;
+}
+
+// Pairwise adds: lane i is the sum of lanes 2i and 2i+1, plus a[i]
+static inline uint16x8_t vpaddlq_u8(uint8x16_t v)
+{
+  uint16x8_t r;
+  for (int i = 0; i < 8; i++) {
+    r[i] = v[2 * i] + v[2 * i + 1];
+  }
+  return r;
+}
+
+static inline uint32x4_t vpaddlq_u16(uint16x8_t v)
+{
+  uint32x4_t r;
+  for (int i = 0; i < 4; i++) {
+    r[i] = (uint32_t)v[2 * i] + v[2 * i + 1];
+  }
+  return r;
+}
+
+static inline uint64x2_t vpaddlq_u32(uint32x4_t v)
+{
+  uint64x2_t r;
+  for (int i = 0; i < 2; i++) {
+    r[i] = (uint64_t)v[2 * i] + v[2 * i + 1];
+  }
+  return r;
+}
+
+static inline uint16x8_t vpadalq_u8(uint16x8_t a, uint8x16_t v) { return a + vpaddlq_u8(v); }
+static inline uint32x4_t vpadalq_u16(uint32x4_t a, uint16x8_t v) { return a + vpaddlq_u16(v); }
+
+// Lane-wise arithmetic, wrapping like NEON
+static inline int16x8_t vaddq_s16(int16x8_t a, int16x8_t b) { return a + b; }
+static inline int16x8_t vsubq_s16(int16x8_t a, int16x8_t b) { return a - b; }
+static inline uint16x8_t vsubq_u16(uint16x8_t a, uint16x8_t b) { return a - b; }
+static inline uint16x8_t vmulq_n_u16(uint16x8_t a, uint16_t b) { return a * b; }
+static inline uint16x8_t vmlaq_n_u16(uint16x8_t a, uint16x8_t b, uint16_t c) { return a + b * c; }
+static inline int16x8_t vshlq_n_s16(int16x8_t a, int n) { return a << n; }
+static inline uint16x8_t vshrq_n_u16(uint16x8_t a, int n) { return a >> n; }
+static inline uint16x8_t vandq_u16(uint16x8_t a, uint16x8_t b) { return a & b; }
+
+static inline int16x8_t vabsq_s16(int16x8_t a)
+{
+  return (a < 0) ? -a : a;
+}
+
+// Comparisons set every bit of the lanes where they hold
+static inline uint16x8_t vcgtq_u16(uint16x8_t a, uint16x8_t b) { return (uint16x8_t)(a > b); }
+static inline uint16x8_t vcgeq_u16(uint16x8_t a, uint16x8_t b) { return (uint16x8_t)(a >= b); }
+
+#endif
+
+#endif
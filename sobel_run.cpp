@@ -0,0 +1,363 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "opencv2/imgproc/imgproc.hpp"
+#include "opencv2/highgui/highgui.hpp"
+#include <iostream>
+#include <fstream>
+#include <unistd.h>
+#include <string.h>
+#include <err.h>
+
+#include "sobel_alg.h"
+#include "pc.h"
+#include "video_src.h"
+#include "metrics.h"
+#include "energy.h"
+#include "display.h"
+#include "autotune.h"
+
+using namespace std;
+using namespace cv;
+
+static ofstream results_file;
+
+// A webcam that fails this many reads in a row, WEBCAM_RETRY_US apart, is
+// taken to be gone and ends the run
+#define WEBCAM_MAX_FAILURES 50
+#define WEBCAM_RETRY_US 20000
+
+// Per-stage accounting for the driver. Cycles, L1 misses, instructions and
+// energy are only measured on worker 0 (the calling thread); every worker
+// reports its wall time to the metrics endpoint. The stages leave out
+// worker 0's barrier waits, so frame rate and energy per frame come from
+// the wall time and energy of the whole frame loop instead, and the stages
+// are only a breakdown of it.
+struct run_stats {
+  counters_t perf_counters;
+  struct energy_meter energy;
+  uint64_t *stage_start;    // one per worker
+  uint64_t stage_uj;
+  float cycles_total[NUM_STAGES];
+  float ns_total[NUM_STAGES];
+  float uj_total[NUM_STAGES];
+  float dtlb_total[NUM_STAGES];
+  float l1cm_total, ic_total;
+  uint64_t run_ns, run_uj;
+};
+
+static void stageBegin(struct run_stats *rs, int tid)
+{
+  if (tid == 0) {
+    rs->stage_uj = energy_read_uj(&rs->energy);
+  }
+  rs->stage_start[tid] = metrics_now();
+  if (tid == 0) {
+    pc_start(&rs->perf_counters);
+  }
+}
+
+static void stageEnd(struct run_stats *rs, int tid, int stage)
+{
+  uint64_t cycles = 0, dtlb_misses = 0;
+  if (tid == 0) {
+    pc_stop(&rs->perf_counters);
+    cycles = rs->perf_counters.cycles.count;
+    dtlb_misses = rs->perf_counters.dtlb_misses.count;
+    rs->cycles_total[stage] += cycles;
+    rs->dtlb_total[stage] += dtlb_misses;
+    rs->l1cm_total += rs->perf_counters.l1_misses.count;
+    rs->ic_total += rs->perf_counters.ic.count;
+  }
+  uint64_t ns = metrics_now() - rs->stage_start[tid];
+  if (tid == 0) {
+    rs->ns_total[stage] += ns;
+    rs->uj_total[stage] += energy_read_uj(&rs->energy) - rs->stage_uj;
+  }
+  metrics_stage(tid, stage, ns, cycles, dtlb_misses);
+}
+
+// sobel_stage_hook: library stages map onto the gray and sobel metrics stages
+static void stageHook(void *arg, int worker, int stage, int begin)
+{
+  struct run_stats *rs = (struct run_stats *)arg;
+
+  int metrics_stage_id = (stage == SOBEL_STAGE_GRAY) ? STAGE_GRAY : STAGE_SOBEL;
+  if (begin) {
+    stageBegin(rs, worker);
+  } else {
+    stageEnd(rs, worker, metrics_stage_id);
+    if (stage == SOBEL_STAGE_SOBEL) {
+      metrics_worker_frame(worker);
+    }
+  }
+}
+
+/*******************************************
+ * Model: runSobel
+ * Input: None
+ * Output: None
+ * Desc: This method pulls in images from the webcam or a file, feeds them
+ *   to a SobelContext in batches of opts.batch frames, and hands the
+ *   Sobel filtered image of the last frame of each batch to the display
+ *   sink (none with --no-display). The display stage is only the copy into
+ *   the sink's buffers; showing the frame happens on the sink thread. The
+ *   context is scheduled as autotuned for this host and input (tuning
+ *   first with --autotune); -j still picks the worker count. This function
+ *   processes opts.numFrames frames and writes st_perf.csv (one thread) or
+ *   mt_perf.csv.
+ ********************************************/
+void runSobel()
+{
+  static struct run_stats rs;
+  static struct display_sink display;
+  float edge_sum_total = 0, edge_count_total = 0, cpufreq_total = 0;
+  int i = 0;
+
+  pc_init(&rs.perf_counters, 0);
+  energy_init(&rs.energy);
+
+  struct video_src video;
+  vsrc_open(&video, opts.videoFile, opts.webcam, opts.loop);
+
+  struct sobel_config config;
+  sobelConfigInit(&config);
+  config.width = IMG_WIDTH;
+  config.height = IMG_HEIGHT;
+  config.pyr_levels = opts.pyrLevels;
+  config.wide_output = opts.wideOutput;
+  config.edge_stats = opts.edgeStats;
+  config.edge_threshold = opts.edgeThreshold;
+  config.pages = opts.pages;
+
+  // Captures decode to BGR; mapped files are handed out as stored
+  int frame_type = video.cap ? CV_8UC3 : video.type;
+  struct autotune_result tuned;
+  const char *schedule_source = "defaults";
+  if (opts.autotune) {
+    autotune_run(&config, frame_type, opts.batch, &tuned);
+    autotune_save(&config, frame_type, opts.batch, &tuned);
+    autotune_apply(&tuned, &config);
+    schedule_source = "autotuned";
+  } else if (autotune_load(&config, frame_type, opts.batch, &tuned)) {
+    autotune_apply(&tuned, &config);
+    schedule_source = "autotune cache";
+  } else {
+    config.threads = opts.multiThreaded ? NCORES : 1;
+  }
+  if (opts.threads) {
+    config.threads = opts.threads;
+  }
+  const int nthreads = config.threads;
+  metrics_init(nthreads);
+  rs.stage_start = new uint64_t[nthreads];
+
+  SobelContext ctx(config);
+  if (ctx.error()) {
+    errx(1, "%s", ctx.error());
+  }
+  char schedule[128];
+  autotune_describe(&ctx.config(), schedule, sizeof(schedule));
+  if (opts.autotune) {
+    fprintf(stderr, "autotune: %s, %.3f ms per frame\n", schedule, tuned.ns_per_frame / 1e6);
+  }
+  ctx.set_stage_hook(stageHook, &rs);
+  if (!opts.noDisplay) {
+    display_start(&display, opts.pyrLevels);
+  }
+
+  // OpenCV hands out the same buffer on every read, so frames of a batch
+  // have to be copied out, into aligned buffers allocated on the first
+  // batch; mapped files are distinct views already
+  struct sobel_arena frame_arena;
+  memset(&frame_arena, 0, sizeof(frame_arena));
+  Mat *frames = new Mat[opts.batch];
+  Mat src;
+  bool copy_frames = video.cap != NULL && opts.batch > 1;
+  bool stop = false;
+  int webcam_failures = 0;
+  uint64_t run_start_uj = energy_read_uj(&rs.energy);
+  uint64_t run_start_ns = metrics_now();
+
+  while (!stop) {
+    int count = 0;
+    while (count < opts.batch && i + count < opts.numFrames) {
+      stageBegin(&rs, 0);
+      bool got_frame = vsrc_read(&video, src);
+      stageEnd(&rs, 0, STAGE_CAPTURE);
+      if (!got_frame) {
+        // A webcam hiccup loses a frame; a file running out ends the run
+        if (opts.webcam && ++webcam_failures < WEBCAM_MAX_FAILURES) {
+          metrics_dropped(0);
+          usleep(WEBCAM_RETRY_US);
+          continue;
+        }
+        if (opts.webcam) {
+          warnx("webcam: %d reads failed in a row, stopping", webcam_failures);
+        }
+        stop = true;
+        break;
+      }
+      webcam_failures = 0;
+      if (copy_frames) {
+        if (frame_arena.base == NULL) {
+          if (sobelArenaInit(&frame_arena, opts.batch * sobelFrameBytes(src.rows, src.cols, src.type()),
+                             opts.pages) < 0) {
+            err(1, "cannot map %d frame buffers", opts.batch);
+          }
+          for (int k = 0; k < opts.batch; k++) {
+            frames[k] = sobelArenaMat(&frame_arena, src.rows, src.cols, src.type());
+          }
+        }
+        src.copyTo(frames[count]);
+      } else {
+        frames[count] = src;
+      }
+      count++;
+      metrics_queue_depth(QUEUE_CAPTURE, count);
+    }
+    if (count == 0) {
+      break;
+    }
+
+    struct sobel_result* results = ctx.process_batch(frames, count);
+    if (results == NULL) {
+      errx(1, "%s", ctx.error());
+    }
+    metrics_queue_depth(QUEUE_CAPTURE, 0);
+    metrics_frames(0, count);
+
+    if (!opts.noDisplay) {
+      stageBegin(&rs, 0);
+      display_submit(&display, results[count - 1].sobel);
+      stageEnd(&rs, 0, STAGE_DISPLAY);
+    }
+
+    if (opts.edgeStats) {
+      for (int k = 0; k < count; k++) {
+        edge_sum_total += results[k].stats.frame.sum;
+        edge_count_total += results[k].stats.frame.count;
+      }
+    }
+    cpufreq_total += cpufreq_read_hz() * count;
+    i += count;
+
+    // exit condition
+    if ((!opts.noDisplay && display_quit(&display)) || i >= opts.numFrames) {
+      break;
+    }
+  }
+
+  rs.run_ns = metrics_now() - run_start_ns;
+  rs.run_uj = energy_read_uj(&rs.energy) - run_start_uj;
+
+  if (!opts.noDisplay) {
+    display_stop(&display);
+  }
+  delete[] frames;
+  sobelArenaFree(&frame_arena);
+  if (i == 0) {
+    errx(1, "No frames read from %s", opts.webcam ? "webcam" : opts.videoFile);
+  }
+
+  float total_time = 0, total_ns = 0, total_uj = 0;
+  for (int st = 0; st < NUM_STAGES; st++) {
+    total_time += rs.cycles_total[st];
+    total_ns += rs.ns_total[st];
+    total_uj += rs.uj_total[st];
+  }
+
+  // Stage shares by cycles, or by wall time without a cycle counter
+  const float *share = (total_time > 0) ? rs.cycles_total : rs.ns_total;
+  float share_total = (total_time > 0) ? total_time : total_ns;
+
+  // Prefer the cycle counter for frequency, then cpufreq, then the constant
+  float freq = PROC_FREQ;
+  const char *freq_source = "assumed PROC_FREQ, no cycle counter or cpufreq";
+  if (total_time > 0) {
+    freq = total_time/(total_ns/1e9);
+    freq_source = "measured, cycle counter";
+  } else if (cpufreq_total > 0) {
+    freq = cpufreq_total/i;
+    freq_source = "measured, cpufreq";
+  }
+
+  // Measured energy if the machine exposes it, else the PROC_EPC model
+  float fps = i/(rs.run_ns/1e9);
+  float total_epf;
+  bool energy_measured = rs.energy.source != ENERGY_NONE;
+  if (energy_measured) {
+    total_epf = rs.run_uj/1e6/i;
+  } else {
+    total_epf = PROC_EPC*NCORES/fps;
+  }
+
+  results_file.open((nthreads > 1) ? "mt_perf.csv" : "st_perf.csv", ios::out);
+  results_file << "Percent of time per function" << endl;
+  results_file << "Capture, " << (share[STAGE_CAPTURE]/share_total)*100 << "%" << endl;
+  results_file << "Grayscale, " << (share[STAGE_GRAY]/share_total)*100 << "%" << endl;
+  results_file << "Sobel, " << (share[STAGE_SOBEL]/share_total)*100 << "%" << endl;
+  results_file << "Display, " << (share[STAGE_DISPLAY]/share_total)*100 << "%" << endl;
+  results_file << "\nSummary" << endl;
+  results_file << "Frames per second, " << fps << endl;
+  results_file << "Run time (s), " << rs.run_ns/1e9 << endl;
+  results_file << "Cycles per frame, " << total_time/i << endl;
+  results_file << "CPU frequency (MHz), " << freq/1e6 << " (" << freq_source << ")" << endl;
+  results_file << "Energy per frames (mJ), " << total_epf*1000 << endl;
+  if (energy_measured) {
+    char sensors[256];
+    energy_describe(&rs.energy, sensors, sizeof(sensors));
+    results_file << "Energy source, " << energy_source_name(&rs.energy) << " (" << sensors << ")" << endl;
+  } else {
+    results_file << "Energy source, model (PROC_EPC x NCORES), no RAPL package or hwmon total readable" << endl;
+  }
+  results_file << "Total frames, " << i << endl;
+  results_file << "Threads, " << nthreads << endl;
+  results_file << "Frames per batch, " << opts.batch << endl;
+  results_file << "Scheduling, " << schedule << " (" << schedule_source << ")" << endl;
+  if (opts.noDisplay) {
+    results_file << "Frames displayed, none (--no-display)" << endl;
+  } else {
+    results_file << "Frames displayed, " << display.shown << endl;
+    results_file << "Frames skipped by display, " << display.skipped << endl;
+  }
+  results_file << "Frame buffers, " << sobelPagesName(ctx.pages()) << ", "
+               << SOBEL_ALIGN << "B aligned rows, stride " << sobelFrameStride(config.width, CV_8UC1) << endl;
+  results_file << "\nHardware Stats (Cap + Gray + Sobel + Display)" << endl;
+  results_file << "Instructions per cycle, " << rs.ic_total/total_time << endl;
+  results_file << "L1 misses per frame, " << rs.l1cm_total/i << endl;
+  results_file << "L1 misses per instruction, " << rs.l1cm_total/rs.ic_total << endl;
+  results_file << "Instruction count per frame, " << rs.ic_total/i << endl;
+
+  results_file << "\nMemory per stage (per frame)" << endl;
+  const char *stage_labels[NUM_STAGES] = {"Capture", "Grayscale", "Sobel", "Display"};
+  for (int st = 0; st < NUM_STAGES; st++) {
+    results_file << stage_labels[st] << ", " << rs.ns_total[st]/1000/i << " us, "
+                 << rs.dtlb_total[st]/i << " dTLB misses" << endl;
+  }
+  if (rs.perf_counters.dtlb_misses.fd < 0) {
+    results_file << "(no dTLB counter on this machine)" << endl;
+  }
+
+  if (energy_measured) {
+    results_file << "\nEnergy per stage (mJ per frame, worker 0's stages)" << endl;
+    results_file << "Capture, " << rs.uj_total[STAGE_CAPTURE]/1000/i << endl;
+    results_file << "Grayscale, " << rs.uj_total[STAGE_GRAY]/1000/i << endl;
+    results_file << "Sobel, " << rs.uj_total[STAGE_SOBEL]/1000/i << endl;
+    results_file << "Display, " << rs.uj_total[STAGE_DISPLAY]/1000/i << endl;
+    results_file << "Outside the stages (barrier waits, batching), "
+                 << (rs.run_uj - total_uj)/1000/i << endl;
+  }
+
+  if (opts.edgeStats) {
+    float edge_pixels = float(i) * (config.width - 2) * (config.height - 2);
+    results_file << "\nEdge Stats (full resolution, threshold " << opts.edgeThreshold << ")" << endl;
+    results_file << "Mean gradient magnitude, " << edge_sum_total/edge_pixels << endl;
+    results_file << "Pixels above threshold per frame, " << edge_count_total/i << endl;
+    results_file << "Edge density, " << (edge_count_total/edge_pixels)*100 << "%" << endl;
+  }
+
+  vsrc_close(&video);
+  energy_close(&rs.energy);
+  delete[] rs.stage_start;
+  results_file.close();
+}
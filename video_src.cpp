@@ -0,0 +1,225 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <err.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "sobel_alg.h"
+#include "video_src.h"
+
+// Number of frames past the current one to ask the kernel to read ahead
+#define VSRC_READAHEAD 4
+
+/*******************************************
+ * Model: parseY4M
+ * Input: Mapped file name (for errors)
+ * Output: None directly. Fills in the frame layout of vs
+ * Desc: Parses the YUV4MPEG2 stream header and the first FRAME header.
+ *  Only the Y plane is exposed, so any chroma planes are skipped over.
+ ********************************************/
+static void parseY4M(struct video_src *vs, const char *file)
+{
+  const char *hdr = (const char *)vs->map;
+  const char *hdr_end = (const char *)memchr(hdr, '\n', vs->map_len);
+  if (vs->map_len < 10 || memcmp(hdr, "YUV4MPEG2 ", 10) != 0 || hdr_end == NULL) {
+    errx(1, "%s: not a YUV4MPEG2 file", file);
+  }
+
+  int width = 0, height = 0;
+  char colorspace[16] = "420jpeg";
+  for (const char *p = hdr + 9; p < hdr_end; ) {
+    while (p < hdr_end && *p == ' ') p++;
+    if (p == hdr_end) break;
+
+    if (*p == 'W') {
+      width = atoi(p + 1);
+    } else if (*p == 'H') {
+      height = atoi(p + 1);
+    } else if (*p == 'C') {
+      size_t n = strcspn(p + 1, " \n");
+      if (n >= sizeof(colorspace)) n = sizeof(colorspace) - 1;
+      memcpy(colorspace, p + 1, n);
+      colorspace[n] = '\0';
+    }
+    while (p < hdr_end && *p != ' ') p++;
+  }
+
+  if (width != IMG_WIDTH || height != IMG_HEIGHT) {
+    errx(1, "%s: frames are %dx%d, expected %dx%d", file, width, height, IMG_WIDTH, IMG_HEIGHT);
+  }
+
+  size_t luma = (size_t)width * height;
+  size_t chroma;
+  if (strncmp(colorspace, "mono", 4) == 0) {
+    chroma = 0;
+  } else if (strncmp(colorspace, "420", 3) == 0) {
+    chroma = 2 * (size_t)((width + 1) / 2) * ((height + 1) / 2);
+  } else if (strcmp(colorspace, "422") == 0) {
+    chroma = 2 * (size_t)((width + 1) / 2) * height;
+  } else if (strcmp(colorspace, "444") == 0) {
+    chroma = 2 * luma;
+  } else if (strcmp(colorspace, "444alpha") == 0) {
+    chroma = 3 * luma;
+  } else {
+    errx(1, "%s: unsupported Y4M colorspace C%s", file, colorspace);
+  }
+
+  // Frame headers may carry parameters; we require them to all be the same
+  // length as the first so frames sit at a fixed stride
+  const char *frame = hdr_end + 1;
+  size_t left = vs->map_len - (frame - hdr);
+  const char *frame_end = (const char *)memchr(frame, '\n', left);
+  if (left < 5 || memcmp(frame, "FRAME", 5) != 0 || frame_end == NULL) {
+    errx(1, "%s: no frames", file);
+  }
+  size_t frame_hdr = frame_end + 1 - frame;
+
+  vs->type = CV_8UC1;
+  vs->frame_hdr = frame_hdr;
+  vs->data_off = (frame - hdr) + frame_hdr;
+  vs->frame_stride = frame_hdr + luma + chroma;
+  vs->num_frames = left / vs->frame_stride;
+}
+
+/*******************************************
+ * Model: vsrc_open
+ * Input: Video file name, or webcam != 0 for the camera; loop != 0 to
+ *  replay the file from the start when it runs out
+ * Output: None directly. Initializes vs
+ * Desc: Files ending in .y4m, .bgr, .bgra or .gray are memory-mapped and read in
+ *  place; anything else goes through an OpenCV capture
+ ********************************************/
+void vsrc_open(struct video_src *vs, const char *file, int webcam, int loop)
+{
+  memset(vs, 0, sizeof(*vs));
+  vs->loop = loop && !webcam;
+
+  const char *ext = webcam ? NULL : strrchr(file, '.');
+  bool is_y4m = ext && strcmp(ext, ".y4m") == 0;
+  bool is_bgr = ext && strcmp(ext, ".bgr") == 0;
+  bool is_bgra = ext && strcmp(ext, ".bgra") == 0;
+  bool is_gray = ext && strcmp(ext, ".gray") == 0;
+
+  if (!is_y4m && !is_bgr && !is_bgra && !is_gray) {
+    if (webcam) {
+      vs->cap = cvCreateCameraCapture(-1);
+    } else {
+      vs->cap = cvCreateFileCapture(file);
+    }
+    if (vs->cap == NULL) {
+      errx(1, "cannot open video %s", webcam ? "from webcam" : file);
+    }
+    cvSetCaptureProperty(vs->cap, CV_CAP_PROP_FRAME_WIDTH, IMG_WIDTH);
+    cvSetCaptureProperty(vs->cap, CV_CAP_PROP_FRAME_HEIGHT, IMG_HEIGHT);
+    return;
+  }
+
+  int fd = open(file, O_RDONLY);
+  if (fd < 0) {
+    err(1, "%s", file);
+  }
+  struct stat st;
+  if (fstat(fd, &st) < 0) {
+    err(1, "%s", file);
+  }
+  vs->map_len = st.st_size;
+  void *map = mmap(NULL, vs->map_len, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (map == MAP_FAILED) {
+    err(1, "cannot map %s", file);
+  }
+  close(fd);
+  vs->map = (unsigned char *)map;
+
+  // Frames are consumed front to back: let the kernel read ahead
+  // aggressively and drop pages behind us early
+  madvise(vs->map, vs->map_len, MADV_SEQUENTIAL);
+
+  if (is_y4m) {
+    parseY4M(vs, file);
+  } else {
+    int channels = is_bgra ? 4 : is_bgr ? 3 : 1;
+    vs->type = is_bgra ? CV_8UC4 : is_bgr ? CV_8UC3 : CV_8UC1;
+    vs->data_off = 0;
+    vs->frame_stride = (size_t)IMG_WIDTH * IMG_HEIGHT * channels;
+    vs->num_frames = vs->map_len / vs->frame_stride;
+    if (vs->map_len % vs->frame_stride) {
+      warnx("%s: ignoring %zu trailing bytes", file, vs->map_len % vs->frame_stride);
+    }
+  }
+
+  if (vs->num_frames == 0) {
+    errx(1, "%s: no complete frames", file);
+  }
+}
+
+/*******************************************
+ * Model: vsrc_read
+ * Input: None
+ * Output: false once the video runs out of frames (never when looping),
+ *  or when a webcam read fails
+ * Desc: Points frame at the next frame. For mapped files this is a view of
+ *  the (read-only) mapping and stays valid until vsrc_close; for captures
+ *  it is valid until the next vsrc_read.
+ ********************************************/
+bool vsrc_read(struct video_src *vs, Mat& frame)
+{
+  if (vs->cap) {
+    IplImage *img = cvQueryFrame(vs->cap);
+    if (img == NULL && vs->loop) {
+      cvSetCaptureProperty(vs->cap, CV_CAP_PROP_POS_FRAMES, 0);
+      img = cvQueryFrame(vs->cap);
+    }
+    if (img == NULL) {
+      return false;
+    }
+    frame = img;
+    return true;
+  }
+
+  if (vs->next == vs->num_frames) {
+    if (!vs->loop) {
+      return false;
+    }
+    vs->next = 0;
+  }
+  unsigned char *pixels = vs->map + vs->data_off + vs->next * vs->frame_stride;
+  if (vs->frame_hdr && memcmp(pixels - vs->frame_hdr, "FRAME", 5) != 0) {
+    errx(1, "bad Y4M frame header at frame %ld", vs->next);
+  }
+
+  // Start paging in the next few frames while this one is processed
+  uintptr_t page = sysconf(_SC_PAGESIZE);
+  uintptr_t ahead = ((uintptr_t)pixels + vs->frame_stride) & ~(page - 1);
+  uintptr_t map_end = (uintptr_t)vs->map + vs->map_len;
+  if (ahead < map_end) {
+    size_t len = VSRC_READAHEAD * vs->frame_stride;
+    if (ahead + len > map_end) len = map_end - ahead;
+    madvise((void *)ahead, len, MADV_WILLNEED);
+  }
+
+  frame = Mat(IMG_HEIGHT, IMG_WIDTH, vs->type, pixels);
+  vs->next++;
+  return true;
+}
+
+/*******************************************
+ * Model: vsrc_close
+ * Input: None
+ * Output: None
+ * Desc: Releases the capture or unmaps the file. Frames handed out by
+ *  vsrc_read are invalid afterwards.
+ ********************************************/
+void vsrc_close(struct video_src *vs)
+{
+  if (vs->cap) {
+    cvReleaseCapture(&vs->cap);
+  }
+  if (vs->map) {
+    munmap(vs->map, vs->map_len);
+  }
+  memset(vs, 0, sizeof(*vs));
+}
@@ -0,0 +1,36 @@
+#ifndef VIDEO_SRC_H
+#define VIDEO_SRC_H
+
+#include <stddef.h>
+#include "opencv2/highgui/highgui.hpp"
+
+using namespace cv;
+
+// A source of IMG_WIDTH x IMG_HEIGHT frames. Either an OpenCV capture
+// (webcam or compressed video) or an uncompressed file mapped into memory:
+//   .y4m   YUV4MPEG2 (mono, 420 or 444), frames are the Y plane (gray)
+//   .bgr   raw packed BGR frames
+//   .bgra  raw packed BGRA frames, as written by most capture cards
+//   .gray  raw 8-bit gray frames
+// Mapped frames are handed out as read-only views of the mapping, with no
+// decode or copy. A file ends the stream when it runs out, unless opened
+// with loop set, in which case it is replayed from the start.
+struct video_src {
+  CvCapture *cap;
+
+  unsigned char *map;
+  size_t map_len;
+  size_t data_off;      // offset of the first frame's pixels
+  size_t frame_stride;  // bytes from one frame's pixels to the next
+  size_t frame_hdr;     // Y4M "FRAME" header length, 0 for raw files
+  int type;             // CV_8UC3, CV_8UC4 or CV_8UC1
+  long num_frames;
+  long next;
+  int loop;
+};
+
+void vsrc_open(struct video_src *vs, const char *file, int webcam, int loop);
+bool vsrc_read(struct video_src *vs, Mat& frame);
+void vsrc_close(struct video_src *vs);
+
+#endif